@@ -0,0 +1,144 @@
+/*
+ * Benchmark of the SPSC ring buffer against the linked-list queue, passing
+ * strings through FIFO order with q_insert_tail()/q_remove_head() on one
+ * side and spsc_insert_tail()/spsc_remove_head() on the other.
+ *
+ * The single-thread case alternates bursts of inserts and removes. The
+ * pipeline case runs one producer and one consumer thread; the list is
+ * shared under a mutex, since queue.c has no synchronization.
+ * The list allocates through the test harness like qtest does, with
+ * cautious mode off. Run with "make bench".
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+#define INTERNAL 1
+#include "harness.h"
+#include "spsc.h"
+
+/* Number of strings passed through each queue */
+#define N_ITEMS (1 << 21)
+/* Strings inserted and then removed in each single-thread round */
+#define BURST 256
+/* Capacity of the ring */
+#define RING_CAP 1024
+
+static const char *item = "pipeline-item";
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double bench_list_serial(int layout)
+{
+    struct list_head *q = q_new_layout(layout);
+    char buf[SPSC_SLOT];
+    double start = now_ns();
+    for (int n = 0; n < N_ITEMS; n += BURST) {
+        for (int i = 0; i < BURST; i++)
+            q_insert_tail(q, (char *) item);
+        for (int i = 0; i < BURST; i++)
+            q_release_element(q_remove_head(q, buf, sizeof(buf)));
+    }
+    double elapsed = now_ns() - start;
+    q_free(q);
+    return elapsed / N_ITEMS;
+}
+
+static double bench_ring_serial(void)
+{
+    spsc_t *r = spsc_new(RING_CAP);
+    char buf[SPSC_SLOT];
+    double start = now_ns();
+    for (int n = 0; n < N_ITEMS; n += BURST) {
+        for (int i = 0; i < BURST; i++)
+            spsc_insert_tail(r, item);
+        for (int i = 0; i < BURST; i++)
+            spsc_remove_head(r, buf, sizeof(buf));
+    }
+    double elapsed = now_ns() - start;
+    spsc_free(r);
+    return elapsed / N_ITEMS;
+}
+
+static spsc_t *ring;
+static struct list_head *list;
+static pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *ring_producer(void *arg)
+{
+    for (int n = 0; n < N_ITEMS; n++) {
+        while (!spsc_insert_tail(ring, item))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void *list_producer(void *arg)
+{
+    for (int n = 0; n < N_ITEMS; n++) {
+        pthread_mutex_lock(&list_lock);
+        q_insert_tail(list, (char *) item);
+        pthread_mutex_unlock(&list_lock);
+    }
+    return NULL;
+}
+
+/* Consume N_ITEMS strings on the calling thread while producer runs */
+static double bench_pipeline(void *(*producer)(void *), bool use_ring)
+{
+    char buf[SPSC_SLOT];
+    pthread_t tid;
+    double start = now_ns();
+    if (pthread_create(&tid, NULL, producer, NULL))
+        return 0;
+    for (int n = 0; n < N_ITEMS;) {
+        bool got;
+        if (use_ring) {
+            got = spsc_remove_head(ring, buf, sizeof(buf));
+        } else {
+            pthread_mutex_lock(&list_lock);
+            element_t *e = q_remove_head(list, buf, sizeof(buf));
+            if ((got = e))
+                q_release_element(e);
+            pthread_mutex_unlock(&list_lock);
+        }
+        if (got)
+            n++;
+        else
+            sched_yield();
+    }
+    pthread_join(tid, NULL);
+    return (now_ns() - start) / N_ITEMS;
+}
+
+int main(void)
+{
+    set_cautious_mode(false);
+
+    printf("%-28s %10s\n", "queue", "ns/item");
+    printf("%-28s %10.2lf\n", "list, malloc layout",
+           bench_list_serial(Q_LAYOUT_MALLOC));
+    printf("%-28s %10.2lf\n", "list, arena layout",
+           bench_list_serial(Q_LAYOUT_ARENA));
+    printf("%-28s %10.2lf\n", "ring", bench_ring_serial());
+
+    list = q_new();
+    printf("%-28s %10.2lf\n", "list + mutex, 2 threads",
+           bench_pipeline(list_producer, false));
+    q_free(list);
+    ring = spsc_new(RING_CAP);
+    printf("%-28s %10.2lf\n", "ring, 2 threads",
+           bench_pipeline(ring_producer, true));
+    spsc_free(ring);
+    return 0;
+}
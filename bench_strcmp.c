@@ -0,0 +1,87 @@
+/*
+ * Microbenchmark of the string comparison kernels used by sort and dedup.
+ *
+ * Keys share a long common prefix and differ only near their end, which is
+ * the worst case for strcmp and the case strcmp_simd() is meant for.
+ * Run with "make bench".
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "strcmp_simd.h"
+
+/* Number of keys compared in each round */
+#define N_KEYS 1024
+/* Number of comparisons timed for each key length */
+#define N_CMPS (1 << 22)
+
+static const size_t key_lengths[] = {8, 16, 32, 64, 128, 256, 1024, 4096};
+
+typedef int (*kernel_t)(const char *, size_t, const char *, size_t);
+
+static int libc_strcmp(const char *a, size_t la, const char *b, size_t lb)
+{
+    (void) la;
+    (void) lb;
+    return strcmp(a, b);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Average time of one comparison, in nanoseconds */
+static double time_kernel(kernel_t cmp, char **keys, size_t len, int *sink)
+{
+    int acc = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < N_CMPS; i++) {
+        size_t a = i % N_KEYS, b = (i * 7 + 1) % N_KEYS;
+        acc += cmp(keys[a], len, keys[b], len) > 0;
+    }
+    double elapsed = now_ns() - start;
+    *sink += acc;
+    return elapsed / N_CMPS;
+}
+
+int main(void)
+{
+    kernel_t kernels[] = {libc_strcmp, strcmp_scalar, strcmp_simd};
+    int sink = 0;
+
+    printf("%8s %12s %12s %12s %8s\n", "length", "strcmp", "scalar", "simd",
+           "speedup");
+    for (size_t l = 0; l < sizeof(key_lengths) / sizeof(*key_lengths); l++) {
+        size_t len = key_lengths[l];
+        char **keys = malloc(N_KEYS * sizeof(*keys));
+        if (!keys)
+            return 1;
+        for (int i = 0; i < N_KEYS; i++) {
+            if (!(keys[i] = malloc(len + 1)))
+                return 1;
+            memset(keys[i], 'k', len);
+            /* Make the keys differ only in their last 4 bytes */
+            for (size_t j = len > 4 ? len - 4 : 0; j < len; j++)
+                keys[i][j] = 'a' + rand() % 26;
+            keys[i][len] = '\0';
+        }
+
+        double ns[3];
+        for (int k = 0; k < 3; k++)
+            ns[k] = time_kernel(kernels[k], keys, len, &sink);
+        printf("%8zu %10.2lfns %10.2lfns %10.2lfns %7.2lfx\n", len, ns[0],
+               ns[1], ns[2], ns[0] / ns[2]);
+
+        for (int i = 0; i < N_KEYS; i++)
+            free(keys[i]);
+        free(keys);
+    }
+    return sink == -1;
+}
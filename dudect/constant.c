@@ -24,6 +24,9 @@ const int drop_size = 20;
  * we do not want the test to affect the original functionality
  */
 static struct list_head *l = NULL;
+static q_pq_t *pq = NULL;
+
+int dut_layout = Q_LAYOUT_MALLOC;
 
 static char random_string[N_MEASURE][8];
 static int random_string_iter = 0;
@@ -33,12 +36,16 @@ enum {
     test_insert_tail,
     test_remove_head,
     test_remove_tail,
+    test_size,
+    test_pq_insert,
+    test_mid,
 };
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
 {
     l = NULL;
+    pq = NULL;
 }
 
 char *get_random_string(void)
@@ -69,7 +76,8 @@ void measure(int64_t *before_ticks,
              int mode)
 {
     assert(mode == test_insert_head || mode == test_insert_tail ||
-           mode == test_remove_head || mode == test_remove_tail);
+           mode == test_remove_head || mode == test_remove_tail ||
+           mode == test_size || mode == test_pq_insert || mode == test_mid);
 
     switch (mode) {
     case test_insert_head:
@@ -126,6 +134,32 @@ void measure(int64_t *before_ticks,
             dut_free();
         }
         break;
+    case test_pq_insert:
+        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
+            char *s = get_random_string();
+            dut_pq_new();
+            dut_pq_insert(
+                get_random_string(),
+                *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            before_ticks[i] = cpucycles();
+            dut_pq_insert(s, 1);
+            after_ticks[i] = cpucycles();
+            dut_pq_free();
+        }
+        break;
+    case test_mid:
+        for (size_t i = drop_size; i < n_measure - drop_size; i++) {
+            dut_new();
+            dut_insert_head(
+                get_random_string(),
+                *(uint16_t *) (input_data + i * chunk_size) % 10000);
+            before_ticks[i] = cpucycles();
+            q_peek_mid(l);
+            after_ticks[i] = cpucycles();
+            dut_free();
+        }
+        break;
+    case test_size:
     default:
         for (size_t i = drop_size; i < n_measure - drop_size; i++) {
             dut_new();
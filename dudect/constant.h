@@ -2,7 +2,11 @@
 #define DUDECT_CONSTANT_H
 
 #include <stdint.h>
-#define dut_new() ((void) (l = q_new()))
+
+/* Argument passed to q_new_layout() for the queue under measurement */
+extern int dut_layout;
+
+#define dut_new() ((void) (l = q_new_layout(dut_layout)))
 
 #define dut_size(n)                                \
     do {                                           \
@@ -26,6 +30,17 @@
 
 #define dut_free() ((void) (q_free(l)))
 
+#define dut_pq_new() ((void) (pq = q_pq_new(dut_layout)))
+
+#define dut_pq_insert(s, n)     \
+    do {                        \
+        int j = n;              \
+        while (j--)             \
+            q_pq_insert(pq, s); \
+    } while (0)
+
+#define dut_pq_free() ((void) (q_pq_free(pq)))
+
 void init_dut();
 void prepare_inputs(uint8_t *input_data, uint8_t *classes);
 void measure(int64_t *before_ticks,
@@ -190,3 +190,18 @@ bool is_remove_tail_const(void)
 {
     return TEST_CONST("remove_tail", 3);
 }
+
+bool is_size_const(void)
+{
+    return TEST_CONST("size", 4);
+}
+
+bool is_pq_insert_const(void)
+{
+    return TEST_CONST("pq_insert", 5);
+}
+
+bool is_mid_const(void)
+{
+    return TEST_CONST("mid", 6);
+}
@@ -9,5 +9,8 @@ bool is_insert_head_const(void);
 bool is_insert_tail_const(void);
 bool is_remove_head_const(void);
 bool is_remove_tail_const(void);
+bool is_size_const(void);
+bool is_pq_insert_const(void);
+bool is_mid_const(void);
 
 #endif
@@ -2,6 +2,7 @@
 
 #include <setjmp.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,19 +37,32 @@
 typedef struct BELE {
     struct BELE *next, *prev;
     size_t payload_size;
+    /* Whether the block counts against memory_limit */
+    bool limited;
     size_t magic_header; /* Marker to see if block seems legitimate */
-    unsigned char payload[0];
+    /* Keep payloads aligned like those of malloc, whatever the header holds */
+    _Alignas(max_align_t) unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_ele_t;
 
 static block_ele_t *allocated = NULL;
 static size_t allocated_count = 0;
+/*
+ * Most payload bytes of blocks allocated since the limit was set that may
+ * be live at once (0 = unlimited), and the bytes of those live now
+ */
+static size_t memory_limit = 0;
+static size_t limited_bytes = 0;
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
+/* Size of the one block still allowed in noallocate mode (0 = none) */
+static size_t scratch_allowance = 0;
+/* Block granted through scratch_allowance, which may also be freed */
+static void *scratch_block = NULL;
 static bool error_occurred = false;
 static char *error_message = "";
 
@@ -124,9 +138,13 @@ static size_t *find_footer(block_ele_t *b)
  */
 void *test_malloc(size_t size)
 {
+    bool scratch = false;
     if (noallocate_mode) {
-        report_event(MSG_FATAL, "Calls to malloc disallowed");
-        return NULL;
+        if (scratch_block || size > scratch_allowance) {
+            report_event(MSG_FATAL, "Calls to malloc disallowed");
+            return NULL;
+        }
+        scratch = true;
     }
 
     if (fail_allocation()) {
@@ -134,6 +152,13 @@ void *test_malloc(size_t size)
         return NULL;
     }
 
+    if (memory_limit && limited_bytes + size > memory_limit) {
+        report_event(MSG_FATAL,
+                     "Exceeded memory limit of %lu bytes with %lu bytes",
+                     memory_limit, limited_bytes + size);
+        return NULL;
+    }
+
     block_ele_t *new_block =
         malloc(size + sizeof(block_ele_t) + sizeof(size_t));
     if (!new_block) {
@@ -145,6 +170,8 @@ void *test_malloc(size_t size)
     new_block->magic_header = MAGICHEADER;
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->payload_size = size;
+    // cppcheck-suppress nullPointerRedundantCheck
+    new_block->limited = memory_limit != 0;
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
@@ -157,11 +184,16 @@ void *test_malloc(size_t size)
         allocated->prev = new_block;
     allocated = new_block;
     allocated_count++;
+    if (new_block->limited)
+        limited_bytes += size;
 
+    if (scratch) {
+        scratch_block = p;
+        scratch_allowance = 0;
+    }
     return p;
 }
 
-// cppcheck-suppress unusedFunction
 void *test_calloc(size_t nelem, size_t elsize)
 {
     /* Reference: Malloc tutorial
@@ -169,16 +201,19 @@ void *test_calloc(size_t nelem, size_t elsize)
      */
     size_t size = nelem * elsize;  // TODO: check for overflow
     void *ptr = test_malloc(size);
-    memset(ptr, 0, size);
+    if (ptr)
+        memset(ptr, 0, size);
     return ptr;
 }
 
 void test_free(void *p)
 {
-    if (noallocate_mode) {
+    if (noallocate_mode && (!p || p != scratch_block)) {
         report_event(MSG_FATAL, "Calls to free disallowed");
         return;
     }
+    if (p && p == scratch_block)
+        scratch_block = NULL;
 
     if (!p)
         return;
@@ -206,6 +241,8 @@ void test_free(void *p)
     if (bn)
         bn->prev = bp;
 
+    if (b->limited)
+        limited_bytes -= b->payload_size;
     free(b);
     allocated_count--;
 }
@@ -246,6 +283,35 @@ void set_cautious_mode(bool cautious)
 void set_noallocate_mode(bool noallocate)
 {
     noallocate_mode = noallocate;
+    if (!noallocate) {
+        scratch_allowance = 0;
+        scratch_block = NULL;
+    }
+}
+
+/*
+ * Allow a single allocation of at most size bytes while in restricted
+ * allocation mode, along with freeing that block.
+ * The allowance is dropped when restricted allocation mode is unset.
+ */
+void set_scratch_allowance(size_t size)
+{
+    scratch_allowance = size;
+}
+
+/*
+ * Limit the payload bytes of blocks allocated from now on and live at once
+ * to limit (0 = unlimited). Blocks allocated before do not count, even when
+ * they are freed under the limit. An allocation beyond the limit is fatal.
+ */
+void set_memory_limit(size_t limit)
+{
+    memory_limit = limit;
+    if (!limit) {
+        for (block_ele_t *b = allocated; b; b = b->next)
+            b->limited = false;
+        limited_bytes = 0;
+    }
 }
 
 /*
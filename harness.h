@@ -37,6 +37,19 @@ void set_cautious_mode(bool cautious);
  */
 void set_noallocate_mode(bool noallocate);
 
+/*
+ * Allow one allocation of at most size bytes, and freeing it, while in
+ * restricted allocation mode. Used for bounded scratch space.
+ */
+void set_scratch_allowance(size_t size);
+
+/*
+ * Limit the bytes of blocks allocated from now on and live at once to limit
+ * (0 = unlimited), so that freeing older blocks makes no room.
+ * Allocations beyond the limit are fatal, like in restricted allocation mode.
+ */
+void set_memory_limit(size_t limit);
+
 /*
   Return whether any errors have occurred since last time checked
  */
@@ -62,6 +75,7 @@ void trigger_exception(char *msg);
 
 /* Tested program use our versions of malloc and free */
 #define malloc test_malloc
+#define calloc test_calloc
 #define free test_free
 
 /* Use undef to avoid strdup redefined error */
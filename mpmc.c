@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "mpmc.h"
+
+#define CACHE_LINE 64
+
+typedef struct {
+    /*
+     * Position the cell is ready for: pos while it waits for the producer
+     * of pos, pos + 1 while it holds that element for its consumer.
+     */
+    size_t seq;
+    element_t *elem;
+} mpmc_cell_t;
+
+/*
+ * The two indices sit on their own cache lines, away from each other. A
+ * whole line of padding separates them instead of alignment, which malloc()
+ * could not honor.
+ */
+struct mpmc {
+    mpmc_cell_t *cells;
+    size_t mask;
+    char pad1[CACHE_LINE];
+    size_t tail;
+    char pad2[CACHE_LINE];
+    size_t head;
+    char pad3[CACHE_LINE];
+};
+
+mpmc_t *mpmc_new(size_t capacity)
+{
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+
+    mpmc_t *q = malloc(sizeof(*q));
+    if (!q)
+        return NULL;
+    if (!(q->cells = malloc(cap * sizeof(*q->cells)))) {
+        free(q);
+        return NULL;
+    }
+    for (size_t i = 0; i < cap; i++)
+        q->cells[i].seq = i;
+    q->mask = cap - 1;
+    q->tail = q->head = 0;
+    return q;
+}
+
+void mpmc_free(mpmc_t *q)
+{
+    if (!q)
+        return;
+    element_t *e;
+    while ((e = mpmc_remove_head(q, NULL, 0)))
+        q_release_element(e);
+    free(q->cells);
+    free(q);
+}
+
+bool mpmc_insert_tail(mpmc_t *q, element_t *e)
+{
+    mpmc_cell_t *cell;
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (!diff) {
+            /* On failure pos is reloaded with the current tail */
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            /* The consumer of the previous lap has not read this cell */
+            return false;
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->elem = e;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+element_t *mpmc_remove_head(mpmc_t *q, char *sp, size_t bufsize)
+{
+    mpmc_cell_t *cell;
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (!diff) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            /* The producer of this position has not filled the cell */
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+    element_t *e = cell->elem;
+    /* Hand the cell to the producer of the next lap */
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+
+    if (sp && e->value) {
+        strncpy(sp, e->value, bufsize);
+        sp[bufsize - 1] = '\0';
+    }
+    return e;
+}
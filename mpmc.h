@@ -0,0 +1,50 @@
+#ifndef LAB0_MPMC_H
+#define LAB0_MPMC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+/*
+ * Bounded lock-free queue of element_t pointers for any number of producer
+ * and consumer threads (Dmitry Vyukov's MPMC ring). Every cell carries a
+ * sequence number telling whether it is ready to be written or read in the
+ * current lap, so producers and consumers each claim a position with a
+ * single compare-and-swap and never wait on each other's locks.
+ *
+ * Cells are allocated once by mpmc_new() and never freed while the queue is
+ * in use, so there is no node to reclaim: an element belongs to the thread
+ * that inserted it until a consumer removes it, and to that consumer after.
+ * Elements are allocated and released by the caller, e.g. with q_new() and
+ * q_remove_head() or q_release_element(), outside the concurrent section.
+ */
+typedef struct mpmc mpmc_t;
+
+/*
+ * Create an empty queue holding up to capacity elements, rounded up to a
+ * power of two.
+ * Return NULL if could not allocate space.
+ */
+mpmc_t *mpmc_new(size_t capacity);
+
+/*
+ * Free the queue and release the elements still in it.
+ * Must not run concurrently with any other operation on q.
+ */
+void mpmc_free(mpmc_t *q);
+
+/*
+ * Append element e. Safe to call from any number of threads at once.
+ * Return false if the queue is full.
+ */
+bool mpmc_insert_tail(mpmc_t *q, element_t *e);
+
+/*
+ * Remove the oldest element, copying its string to sp like q_remove_head()
+ * if sp is non-NULL. Safe to call from any number of threads at once.
+ * Return NULL if the queue is empty.
+ */
+element_t *mpmc_remove_head(mpmc_t *q, char *sp, size_t bufsize);
+
+#endif /* LAB0_MPMC_H */
@@ -2,6 +2,8 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
@@ -41,7 +43,10 @@
 #include "queue.h"
 
 #include "console.h"
+#include "mpmc.h"
 #include "report.h"
+#include "spsc.h"
+#include "strcmp_simd.h"
 
 /* Settable parameters */
 
@@ -63,6 +68,7 @@ typedef struct {
     struct list_head *l;
     /* meta data of list */
     int size;
+    int layout;
 } list_head_meta_t;
 
 static list_head_meta_t l_meta;
@@ -70,13 +76,81 @@ static list_head_meta_t l_meta;
 /* Number of elements in queue */
 static size_t lcnt = 0;
 
+/* Queues set aside by "stash" for commands working on several queues */
+#define MAX_STASH 16
+#define STASH_NAME_LEN 32
+typedef struct {
+    char name[STASH_NAME_LEN];
+    list_head_meta_t meta;
+    /* Blocks the queue owned when stashed, for leak checks meanwhile */
+    size_t blocks;
+} stash_entry_t;
+
+static stash_entry_t stash[MAX_STASH];
+static int stash_cnt = 0;
+
+/* Ring driven by the spsc_* commands, and number of strings in it */
+static spsc_t *ring = NULL;
+static int ring_cnt = 0;
+
+/*
+ * Snapshot file standing for the file argument TMP, made on first use and
+ * removed at quit, so traces need not pick a path
+ */
+static char tmp_path[64];
+
+/* Priority queue driven by the pq_* commands, and number of strings in it */
+static q_pq_t *pq = NULL;
+static int pq_cnt = 0;
+/* Blocks allocated by the pq_* commands and not freed yet */
+static long pq_blocks = 0;
+/* Blocks of the ring buffer allocated by spsc_new and not freed yet */
+static long ring_blocks = 0;
+
+/*
+ * Blocks owned by the stashed queues, the priority queue and the ring
+ * buffer, which the leak check of the current queue must not count
+ */
+static size_t held_blocks(void)
+{
+    size_t blocks = pq_blocks + ring_blocks;
+    for (int i = 0; i < stash_cnt; i++)
+        blocks += stash[i].blocks;
+    return blocks;
+}
+
 /* How many times can queue operations fail */
 static int fail_limit = BIG_LIST;
 static int fail_count = 0;
 
 static int string_length = MAXSTRING;
 
+/* Element layout of queues created by "new", see Q_LAYOUT_* in queue.h */
+static int layout = Q_LAYOUT_MALLOC;
+/* Whether queues created by "new" cache key prefixes */
+static int key_prefix = 0;
+
+/* Seed of the shuffle generator, set through "option shuffle_seed" */
+static int shuffle_seed = 0;
+
+/*
+ * How dedup checks its result: 0 compares against a full copy of the queue,
+ * 1 against the hashes and lengths of the runs of equal strings.
+ */
+static int dedup_check = 0;
+
+/* Bytes of memory sort_external lets q_sort_external use */
+static int ext_budget = 1 << 16;
+
+/* Room for the header of the node block allocated by q_sort_external */
+#define EXT_NODE_SLACK 256
+
 extern int cmp_count;
+extern int sort_engine;
+extern int cmp_kernel;
+extern int sort_threads;
+extern int sort_serial_cutoff;
+extern int shuffle_inplace;
 
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
@@ -89,6 +163,7 @@ double average_K(int size, int kernel);
 
 /* Function in queue.c */
 extern void q_shuffle(struct list_head *head);
+extern void q_shuffle_seed(uint64_t seed);
 
 typedef int
     __attribute__((nonnull(2, 3))) (*list_cmp_func_t)(void *,
@@ -131,7 +206,7 @@ static bool do_free(int argc, char *argv[])
     lcnt = 0;
     show_queue(3);
 
-    size_t bcnt = allocation_check();
+    size_t bcnt = allocation_check() - held_blocks();
     if (bcnt > 0) {
         report(1, "ERROR: Freed queue, but %lu blocks are still allocated",
                bcnt);
@@ -156,8 +231,9 @@ static bool do_new(int argc, char *argv[])
     error_check();
 
     if (exception_setup(true)) {
-        l_meta.l = q_new();
+        l_meta.l = q_new_layout(layout | (key_prefix ? Q_KEY_PREFIX : 0));
         l_meta.size = 0;
+        l_meta.layout = layout;
     }
     exception_cancel();
     lcnt = 0;
@@ -182,6 +258,100 @@ static void fill_rand_string(char *buf, size_t buf_size)
     buf[len] = '\0';
 }
 
+/*
+ * Path named by a file argument: the temporary file of this run for TMP,
+ * otherwise the argument itself. Return NULL if TMP could not be made.
+ */
+static const char *file_path(const char *arg)
+{
+    if (strcmp(arg, "TMP"))
+        return arg;
+    if (!tmp_path[0]) {
+        const char *dir = getenv("TMPDIR");
+        snprintf(tmp_path, sizeof(tmp_path), "%s/lab0-XXXXXX",
+                 dir && strlen(dir) < sizeof(tmp_path) - 16 ? dir : "/tmp");
+        int fd = mkstemp(tmp_path);
+        if (fd < 0) {
+            tmp_path[0] = '\0';
+            return NULL;
+        }
+        close(fd);
+    }
+    return tmp_path;
+}
+
+/*
+ * Insert reps copies of inserts, or reps random strings if need_rand, at the
+ * head or tail of the queue with a single bulk insertion.
+ */
+static bool insert_bulk(bool at_head, char *inserts, bool need_rand, int reps)
+{
+    char **strs = malloc(reps * sizeof(*strs));
+    char *rand_bufs =
+        need_rand ? malloc((size_t) reps * MAX_RANDSTR_LEN) : NULL;
+    if (!strs || (need_rand && !rand_bufs)) {
+        free(strs);
+        free(rand_bufs);
+        report(1, "INTERNAL ERROR.  Could not allocate space for insertions");
+        return false;
+    }
+    for (int r = 0; r < reps; r++) {
+        strs[r] =
+            need_rand ? rand_bufs + (size_t) r * MAX_RANDSTR_LEN : inserts;
+        if (need_rand)
+            fill_rand_string(strs[r], MAX_RANDSTR_LEN);
+    }
+
+    bool ok = true, rval = false;
+    if (exception_setup(true))
+        rval = at_head ? q_insert_head_bulk(l_meta.l, strs, reps)
+                       : q_insert_tail_bulk(l_meta.l, strs, reps);
+    exception_cancel();
+
+    if (rval) {
+        lcnt += reps;
+        l_meta.size += reps;
+        // Walking away from the end, the new elements hold strs[reps - 1],
+        // strs[reps - 2], ... in both cases
+        struct list_head *node = at_head ? l_meta.l->next : l_meta.l->prev;
+        char *lasts = NULL;
+        for (int r = reps - 1; ok && r >= 0; r--) {
+            char *cur_inserts = list_entry(node, element_t, list)->value;
+            if (!cur_inserts || strcmp(cur_inserts, strs[r])) {
+                report(1, "ERROR: Failed to save copy of string in queue");
+                ok = false;
+            } else if (cur_inserts == strs[r]) {
+                report(1,
+                       "ERROR: Need to allocate and copy string for new "
+                       "queue element");
+                ok = false;
+            } else if (lasts == cur_inserts &&
+                       l_meta.layout != Q_LAYOUT_INTERN) {
+                report(1,
+                       "ERROR: Need to allocate separate string for each "
+                       "queue element");
+                ok = false;
+            }
+            lasts = cur_inserts;
+            node = at_head ? node->next : node->prev;
+        }
+    } else {
+        fail_count++;
+        if (fail_count < fail_limit)
+            report(2, "Insertion of %d strings failed", reps);
+        else {
+            report(1,
+                   "ERROR: Insertion of %d strings failed (%d failures total)",
+                   reps, fail_count);
+            ok = false;
+        }
+    }
+
+    free(strs);
+    free(rand_bufs);
+    return ok && !error_check();
+}
+
 /* insert head */
 static bool do_ih(int argc, char *argv[])
 {
@@ -225,6 +395,12 @@ static bool do_ih(int argc, char *argv[])
         report(3, "Warning: Calling insert head on null queue");
     error_check();
 
+    if (reps > 1) {
+        ok = insert_bulk(true, inserts, need_rand, reps);
+        show_queue(3);
+        return ok;
+    }
+
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
@@ -244,7 +420,8 @@ static bool do_ih(int argc, char *argv[])
                            "queue element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == cur_inserts) {
+                } else if (r == 1 && lasts == cur_inserts &&
+                           l_meta.layout != Q_LAYOUT_INTERN) {
                     report(1,
                            "ERROR: Need to allocate separate string for each "
                            "queue element");
@@ -314,6 +491,12 @@ static bool do_it(int argc, char *argv[])
         report(3, "Warning: Calling insert tail on null queue");
     error_check();
 
+    if (reps > 1) {
+        ok = insert_bulk(false, inserts, need_rand, reps);
+        show_queue(3);
+        return ok;
+    }
+
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
@@ -476,6 +659,260 @@ static inline bool do_rt(int argc, char *argv[])
     return do_remove(1, argc, argv);
 }
 
+/*
+ * Insert a heap copy of str at the head (option 0) or tail (option 1) of the
+ * queue with q_insert_*_take, and check the queue adopted that very copy.
+ */
+static bool do_insert_take(int option, int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling insert on null queue");
+    error_check();
+
+    /*
+     * Allocated like the queue's own strings, so the queue can free it, but
+     * exempt from injected malloc failures, which target the queue code
+     */
+    int saved_probability = fail_probability;
+    fail_probability = 0;
+    char *s = test_strdup(argv[1]);
+    fail_probability = saved_probability;
+    if (!s) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for string");
+        return false;
+    }
+
+    bool ok = true, rval = false;
+    if (exception_setup(true))
+        rval = option ? q_insert_tail_take(l_meta.l, s, strlen(s))
+                      : q_insert_head_take(l_meta.l, s, Q_LEN_UNKNOWN);
+    exception_cancel();
+
+    if (rval) {
+        lcnt++;
+        l_meta.size++;
+        element_t *e = list_entry(option ? l_meta.l->prev : l_meta.l->next,
+                                  element_t, list);
+        if (e->value != s) {
+            report(1, "ERROR: Queue element does not hold the given string");
+            ok = false;
+        }
+    } else {
+        test_free(s);
+        fail_count++;
+        if (fail_count < fail_limit)
+            report(2, "Insertion of %s failed", argv[1]);
+        else {
+            report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                   argv[1], fail_count);
+            ok = false;
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+static inline bool do_ih_take(int argc, char *argv[])
+{
+    return do_insert_take(0, argc, argv);
+}
+
+static inline bool do_it_take(int argc, char *argv[])
+{
+    return do_insert_take(1, argc, argv);
+}
+
+/*
+ * Remove from the head (option 0) or tail (option 1) of the queue with
+ * q_remove_*_take and free the string handed over.
+ */
+static bool do_remove_take(int option, int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.size)
+        report(3, "Warning: Calling remove on empty queue");
+    error_check();
+
+    char *s = NULL;
+    size_t len = 0;
+    if (exception_setup(true))
+        s = option ? q_remove_tail_take(l_meta.l, &len)
+                   : q_remove_head_take(l_meta.l, &len);
+    exception_cancel();
+
+    bool ok = true;
+    if (s) {
+        lcnt--;
+        l_meta.size--;
+        if (len != strlen(s)) {
+            report(1, "ERROR: Length %zu of removed string %s is wrong", len,
+                   s);
+            ok = false;
+        } else if (argc == 2 && strcmp(s, argv[1])) {
+            report(1, "ERROR: Removed value %s != expected value %s", s,
+                   argv[1]);
+            ok = false;
+        } else {
+            report(2, "Removed %s from queue", s);
+        }
+        test_free(s);
+    } else {
+        fail_count++;
+        if (argc == 1 && fail_count < fail_limit) {
+            report(2, "Removal from queue failed");
+        } else {
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+static inline bool do_rh_take(int argc, char *argv[])
+{
+    return do_remove_take(0, argc, argv);
+}
+
+static inline bool do_rt_take(int argc, char *argv[])
+{
+    return do_remove_take(1, argc, argv);
+}
+
+/*
+ * Remove n elements from the head (option 0) or tail (option 1) of the
+ * queue with one bulk removal into a packed buffer of size bytes, and check
+ * the detached list and the copied strings against the nodes that were at
+ * that end of the queue.
+ */
+static bool do_remove_bulk(int option, int argc, char *argv[])
+{
+    int n, size;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    if (!get_int(argv[1], &n) || n < 1) {
+        report(1, "Invalid number of removals '%s'", argv[1]);
+        return false;
+    }
+    size = n * (string_length + 1);
+    if (argc == 3 && (!get_int(argv[2], &size) || size < 1)) {
+        report(1, "Invalid buffer size '%s'", argv[2]);
+        return false;
+    }
+
+    element_t **expect = malloc(n * sizeof(*expect));
+    size_t *offsets = malloc(n * sizeof(*offsets));
+    char *buf = malloc(size);
+    if (!expect || !offsets || !buf) {
+        free(expect);
+        free(offsets);
+        free(buf);
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for removed strings");
+        return false;
+    }
+
+    if (!l_meta.size)
+        report(3, "Warning: Calling remove head on empty queue");
+    error_check();
+
+    /* Nodes at the chosen end, in queue order */
+    int avail = n < l_meta.size ? n : l_meta.size;
+    if (l_meta.l) {
+        struct list_head *node = option ? l_meta.l->prev : l_meta.l->next;
+        for (int i = 0; i < avail; i++) {
+            expect[option ? avail - 1 - i : i] =
+                list_entry(node, element_t, list);
+            node = option ? node->prev : node->next;
+        }
+    }
+
+    LIST_HEAD(removed);
+    size_t cnt = 0;
+    if (exception_setup(true))
+        cnt = option ? q_remove_tail_bulk(l_meta.l, &removed, n, buf, size,
+                                          offsets)
+                     : q_remove_head_bulk(l_meta.l, &removed, n, buf, size,
+                                          offsets);
+    exception_cancel();
+
+    bool ok = true;
+    if (cnt > (size_t) avail) {
+        report(1, "ERROR: Removed %zu elements, only %d available", cnt,
+               avail);
+        ok = false;
+        cnt = avail;
+    }
+    /* Tail removal takes the last cnt of the avail expected nodes */
+    element_t **first = expect + (option ? avail - cnt : 0);
+    size_t i = 0, off = 0;
+    element_t *e;
+    list_for_each_entry (e, &removed, list) {
+        if (!ok)
+            break;
+        if (i == cnt || e != first[i]) {
+            report(1, "ERROR: Removed list does not match queue end");
+            ok = false;
+        } else if (offsets[i] != off || strcmp(buf + off, e->value)) {
+            report(1, "ERROR: Removed value %s not copied to offset %zu",
+                   e->value, off);
+            ok = false;
+        } else {
+            report(2, "Removed %s from queue", buf + off);
+            off += strlen(e->value) + 1;
+            i++;
+        }
+    }
+    if (ok && i != cnt) {
+        report(1, "ERROR: Removed list holds %zu of %zu elements", i, cnt);
+        ok = false;
+    }
+
+    q_release_list(&removed);
+    lcnt -= cnt;
+    l_meta.size -= cnt;
+    if (!cnt) {
+        fail_count++;
+        if (fail_count < fail_limit) {
+            report(2, "Removal from queue failed");
+        } else {
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    show_queue(3);
+    free(expect);
+    free(offsets);
+    free(buf);
+    return ok && !error_check();
+}
+
+static inline bool do_rh_bulk(int argc, char *argv[])
+{
+    return do_remove_bulk(0, argc, argv);
+}
+
+static inline bool do_rt_bulk(int argc, char *argv[])
+{
+    return do_remove_bulk(1, argc, argv);
+}
+
 /* remove head quietly */
 static bool do_rhq(int argc, char *argv[])
 {
@@ -517,6 +954,94 @@ static bool do_rhq(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Run of equal neighbouring strings in the queue before dedup */
+typedef struct {
+    uint64_t hash;
+    size_t count;
+} dedup_run_t;
+
+/* 64-bit FNV-1a hash of string s */
+static uint64_t str_hash64(const char *s)
+{
+    uint64_t h = 14695981039346656037ULL;
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * Check q_delete_dup without copying the queue: remember the hash and
+ * length of each run of equal strings, then walk the survivors, which must
+ * be the strings of the runs of length 1 in the same order.
+ * Takes O(n) time and O(runs) memory.
+ */
+static bool dedup_check_runs(void)
+{
+    dedup_run_t *runs = NULL;
+    size_t n_runs = 0, cap = 0;
+    element_t *item;
+    if (l_meta.l) {
+        list_for_each_entry (item, l_meta.l, list) {
+            if (n_runs &&
+                !strcmp(list_entry(item->list.prev, element_t, list)->value,
+                        item->value)) {
+                runs[n_runs - 1].count++;
+                continue;
+            }
+            if (n_runs == cap) {
+                cap = cap ? 2 * cap : 1024;
+                dedup_run_t *grown = realloc(runs, cap * sizeof(*runs));
+                if (!grown) {
+                    free(runs);
+                    report(1,
+                           "INTERNAL ERROR.  Could not allocate space for "
+                           "duplicate checking");
+                    return false;
+                }
+                runs = grown;
+            }
+            runs[n_runs].hash = str_hash64(item->value);
+            runs[n_runs++].count = 1;
+        }
+    }
+
+    bool ok = true;
+    if (exception_setup(true))
+        ok = q_delete_dup(l_meta.l);
+    exception_cancel();
+
+    if (!ok) {
+        free(runs);
+        report(1, "ERROR: Calling delete duplicate on null queue");
+        return false;
+    }
+
+    struct list_head *l_tmp = l_meta.l->next;
+    for (size_t i = 0; i < n_runs; i++) {
+        if (runs[i].count > 1) {
+            lcnt -= runs[i].count;
+            l_meta.size -= runs[i].count;
+        } else if (l_tmp != l_meta.l &&
+                   str_hash64(list_entry(l_tmp, element_t, list)->value) ==
+                       runs[i].hash)
+            l_tmp = l_tmp->next;
+        else
+            ok = false;
+    }
+    // All elements in new list should be traversed
+    ok = ok && l_tmp == l_meta.l;
+    if (!ok)
+        report(1,
+               "ERROR: Duplicate strings are in queue or distinct strings are "
+               "not in queue");
+    free(runs);
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -524,6 +1049,9 @@ static bool do_dedup(int argc, char *argv[])
         return false;
     }
 
+    if (dedup_check)
+        return dedup_check_runs();
+
     LIST_HEAD(l_copy);
     element_t *item, *tmp;
 
@@ -631,6 +1159,20 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
+    if (simulation) {
+        if (argc != 1) {
+            report(1, "%s does not need arguments in simulation mode", argv[0]);
+            return false;
+        }
+        bool ok = is_size_const();
+        if (!ok) {
+            report(1, "ERROR: Probably not constant time");
+            return false;
+        }
+        report(1, "Probably constant time");
+        return ok;
+    }
+
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
@@ -695,6 +1237,9 @@ bool do_sort(int argc, char *argv[])
     error_check();
 
     set_noallocate_mode(true);
+    /* Array sort needs scratch space for two pointers per element */
+    if (sort_engine == Q_SORT_ARRAY)
+        set_scratch_allowance(2 * cnt * sizeof(element_t *));
     if (exception_setup(true))
         q_sort(l_meta.l);
     exception_cancel();
@@ -740,8 +1285,9 @@ bool do_kernel_sort(int argc, char *argv[])
 
     set_noallocate_mode(true);
     if (exception_setup(true))
-        list_sort(NULL, l_meta.l, my_cmp);
+        list_sort(q_keyed(l_meta.l) ? &l_meta : NULL, l_meta.l, my_cmp);
     exception_cancel();
+    q_list_changed(l_meta.l);
     set_noallocate_mode(false);
 
     bool ok = true;
@@ -765,6 +1311,93 @@ bool do_kernel_sort(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/*
+ * Sort the queue with q_sort_external, allowing it ext_budget bytes of
+ * memory, into the queue or, given a file, into that file as a snapshot.
+ */
+static bool do_sort_external(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes at most 1 argument", argv[0]);
+        return false;
+    }
+    if (ext_budget <= 0) {
+        report(1, "ERROR: ext_budget must be positive");
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling sort on null queue");
+    error_check();
+
+    int cnt = q_size(l_meta.l);
+    const char *path = argc == 2 ? file_path(argv[1]) : NULL;
+    if (argc == 2 && !path) {
+        report(1, "ERROR: Could not create temporary file");
+        return false;
+    }
+
+    /*
+     * Anything beyond the budget is fatal, except the nodes of the sorted
+     * queue when it is loaded back
+     */
+    size_t node_size = sizeof(element_t);
+    if (q_keyed(l_meta.l))
+        node_size += sizeof(element_key_t);
+    set_memory_limit(path ? ext_budget
+                          : ext_budget + (cnt + 1) * node_size +
+                                EXT_NODE_SLACK);
+    bool ok = false;
+    if (exception_setup(true))
+        ok = q_sort_external(l_meta.l, ext_budget, path);
+    exception_cancel();
+    set_memory_limit(0);
+
+    if (!ok) {
+        report(1, "ERROR: External sort failed");
+        return false;
+    }
+
+    if (path) {
+        if (!list_empty(l_meta.l)) {
+            report(1, "ERROR: Queue not empty after sorting into %s", path);
+            ok = false;
+        } else {
+            report(2, "Sorted %d elements into %s", l_meta.size, path);
+            lcnt -= l_meta.size;
+            l_meta.size = 0;
+        }
+    } else if (q_size(l_meta.l) != l_meta.size) {
+        report(1, "ERROR: Queue size is %d after sorting, expected %d",
+               q_size(l_meta.l), l_meta.size);
+        ok = false;
+    } else if (l_meta.size) {
+        for (struct list_head *cur_l = l_meta.l->next;
+             cur_l != l_meta.l && --cnt; cur_l = cur_l->next) {
+            element_t *item, *next_item;
+            item = list_entry(cur_l, element_t, list);
+            next_item = list_entry(cur_l->next, element_t, list);
+            if (strcasecmp(item->value, next_item->value) > 0) {
+                report(1, "ERROR: Not sorted in ascending order");
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/* Node at index size / 2 of the non-empty queue under test */
+static struct list_head *middle_node(void)
+{
+    struct list_head *node = l_meta.l->next;
+    for (int i = l_meta.size / 2; i > 0; i--)
+        node = node->next;
+    return node;
+}
+
 static bool do_dm(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -776,12 +1409,405 @@ static bool do_dm(int argc, char *argv[])
         report(3, "Warning: Try to access null queue");
     error_check();
 
+    // Remember the neighbours of the node that should be deleted
+    struct list_head *before = NULL, *after = NULL;
+    if (l_meta.l && !list_empty(l_meta.l)) {
+        struct list_head *mid = middle_node();
+        before = mid->prev;
+        after = mid->next;
+    }
+
     bool ok = true;
     if (exception_setup(true))
         ok = q_delete_mid(l_meta.l);
     exception_cancel();
 
-    lcnt--;
+    if (ok && before) {
+        lcnt--;
+        l_meta.size--;
+        if (before->next != after) {
+            report(1, "ERROR: Deleted node is not the middle one");
+            ok = false;
+        }
+    }
+    show_queue(3);
+    return ok && !error_check();
+}
+
+static bool do_pm(int argc, char *argv[])
+{
+    if (simulation) {
+        if (argc != 1) {
+            report(1, "%s does not need arguments in simulation mode", argv[0]);
+            return false;
+        }
+        bool ok = is_mid_const();
+        if (!ok) {
+            report(1, "ERROR: Probably not constant time");
+            return false;
+        }
+        report(1, "Probably constant time");
+        return ok;
+    }
+
+    if (argc != 1 && argc != 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Try to access null queue");
+    error_check();
+
+    element_t *item = NULL;
+    if (exception_setup(true))
+        item = q_peek_mid(l_meta.l);
+    exception_cancel();
+
+    bool ok = true;
+    if (!l_meta.l || list_empty(l_meta.l)) {
+        if (item) {
+            report(1, "ERROR: Middle of empty queue is not NULL");
+            ok = false;
+        }
+    } else if (!item || &item->list != middle_node()) {
+        report(1, "ERROR: Returned element is not the middle one");
+        ok = false;
+    } else if (argc == 2 && strcmp(item->value, argv[1])) {
+        report(1, "ERROR: Middle value is %s, expected %s", item->value,
+               argv[1]);
+        ok = false;
+    } else
+        report(2, "Middle of queue is %s", item->value);
+
+    return ok && !error_check();
+}
+
+typedef struct {
+    char *value;
+    size_t pos;
+} dedup_ref_t;
+
+static int dedup_ref_cmp(const void *a, const void *b)
+{
+    const dedup_ref_t *ra = a, *rb = b;
+    int c = strcmp(ra->value, rb->value);
+    if (c)
+        return c;
+    return ra->pos < rb->pos ? -1 : ra->pos > rb->pos;
+}
+
+static bool do_dedup_unsorted(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l || list_empty(l_meta.l)) {
+        report(1, "ERROR: Calling delete duplicate on null queue");
+        return false;
+    }
+
+    // Remember the values in queue order, then find the duplicated ones
+    // by sorting references to them by value and position
+    size_t n = l_meta.size;
+    dedup_ref_t *refs = malloc(n * sizeof(*refs));
+    char **values = calloc(n, sizeof(*values));
+    bool *dup = calloc(n, sizeof(*dup));
+    bool ok = refs && values && dup;
+    size_t i = 0;
+    element_t *item;
+    if (ok) {
+        list_for_each_entry (item, l_meta.l, list) {
+            if (!(values[i] = strdup(item->value))) {
+                ok = false;
+                break;
+            }
+            refs[i].value = values[i];
+            refs[i].pos = i;
+            i++;
+        }
+    }
+    if (!ok) {
+        for (i = 0; values && i < n; i++)
+            free(values[i]);
+        free(refs);
+        free(values);
+        free(dup);
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for "
+               "duplicate checking");
+        return false;
+    }
+    qsort(refs, n, sizeof(*refs), dedup_ref_cmp);
+    for (i = 1; i < n; i++) {
+        if (!strcmp(refs[i - 1].value, refs[i].value))
+            dup[refs[i - 1].pos] = dup[refs[i].pos] = true;
+    }
+
+    if (exception_setup(true))
+        ok = q_delete_dup_unsorted(l_meta.l);
+    exception_cancel();
+
+    if (ok) {
+        // Survivors must be exactly the distinct values, in original order
+        struct list_head *l_tmp = l_meta.l->next;
+        for (i = 0; i < n; i++) {
+            if (dup[i]) {
+                lcnt--;
+                l_meta.size--;
+            } else if (l_tmp != l_meta.l &&
+                       !strcmp(list_entry(l_tmp, element_t, list)->value,
+                               values[i]))
+                l_tmp = l_tmp->next;
+            else
+                ok = false;
+        }
+        ok = ok && l_tmp == l_meta.l;
+        if (!ok)
+            report(1,
+                   "ERROR: Duplicate strings are in queue or distinct strings "
+                   "are not in queue in their original order");
+    } else
+        report(1, "ERROR: Could not allocate space for the hash table");
+
+    for (i = 0; i < n; i++)
+        free(values[i]);
+    free(refs);
+    free(values);
+    free(dup);
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/* Return the index of the queue stashed under name, or -1 */
+static int stash_find(const char *name)
+{
+    for (int i = 0; i < stash_cnt; i++) {
+        if (!strcmp(stash[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+/* Set the current queue aside under a name, leaving no current queue */
+static bool do_stash(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!l_meta.l) {
+        report(1, "ERROR: No queue to stash");
+        return false;
+    }
+    if (strlen(argv[1]) >= STASH_NAME_LEN) {
+        report(1, "ERROR: Name '%s' is too long", argv[1]);
+        return false;
+    }
+    if (stash_find(argv[1]) >= 0) {
+        report(1, "ERROR: A queue is already stashed as '%s'", argv[1]);
+        return false;
+    }
+    if (stash_cnt == MAX_STASH) {
+        report(1, "ERROR: Cannot stash more than %d queues", MAX_STASH);
+        return false;
+    }
+
+    strcpy(stash[stash_cnt].name, argv[1]);
+    stash[stash_cnt].meta = l_meta;
+    stash[stash_cnt].blocks = allocation_check() - held_blocks();
+    stash_cnt++;
+    report(2, "Stashed queue of %d elements as %s", l_meta.size, argv[1]);
+    l_meta.l = NULL;
+    l_meta.size = 0;
+    lcnt = 0;
+    return true;
+}
+
+/* Make the queue stashed under a name current again */
+static bool do_unstash(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    int i = stash_find(argv[1]);
+    if (i < 0) {
+        report(1, "ERROR: No queue is stashed as '%s'", argv[1]);
+        return false;
+    }
+    if (l_meta.l) {
+        report(1, "ERROR: Stash or free the current queue first");
+        return false;
+    }
+
+    l_meta = stash[i].meta;
+    lcnt = l_meta.size;
+    stash[i] = stash[--stash_cnt];
+    show_queue(3);
+    return true;
+}
+
+/*
+ * Merge the sorted current queue with the named sorted stashed queues, in
+ * that order, with q_merge. The stashed queues are freed afterwards.
+ */
+static bool do_merge(int argc, char *argv[])
+{
+    if (argc < 2) {
+        report(1, "%s needs at least 1 argument", argv[0]);
+        return false;
+    }
+    if (!l_meta.l) {
+        report(1, "ERROR: No current queue to merge into");
+        return false;
+    }
+
+    struct list_head *queues[MAX_STASH + 1] = {l_meta.l};
+    bool used[MAX_STASH] = {false};
+    int total = l_meta.size;
+    for (int a = 1; a < argc; a++) {
+        int i = stash_find(argv[a]);
+        if (i < 0 || used[i]) {
+            report(1, "ERROR: No unused queue is stashed as '%s'", argv[a]);
+            return false;
+        }
+        used[i] = true;
+        queues[a] = stash[i].meta.l;
+        total += stash[i].meta.size;
+    }
+    error_check();
+
+    int rval = 0;
+    set_noallocate_mode(true);
+    if (exception_setup(true))
+        rval = q_merge(queues, argc);
+    exception_cancel();
+    set_noallocate_mode(false);
+
+    bool ok = true;
+    lcnt = l_meta.size = total;
+    if (rval != total || q_size(l_meta.l) != total) {
+        report(1, "ERROR: Merged queue has %d elements, expected %d",
+               q_size(l_meta.l), total);
+        ok = false;
+    }
+    for (struct list_head *cur = l_meta.l->next;
+         ok && cur != l_meta.l && cur->next != l_meta.l; cur = cur->next) {
+        if (strcmp(list_entry(cur, element_t, list)->value,
+                   list_entry(cur->next, element_t, list)->value) > 0) {
+            report(1, "ERROR: Not sorted in ascending order");
+            ok = false;
+        }
+    }
+
+    /* Drop the merged stashed queues, keeping the others in order */
+    int kept = 0;
+    for (int i = 0; i < stash_cnt; i++) {
+        if (!used[i]) {
+            stash[kept++] = stash[i];
+            continue;
+        }
+        if (!list_empty(stash[i].meta.l)) {
+            report(1, "ERROR: Queue %s is not empty after merge",
+                   stash[i].name);
+            ok = false;
+        }
+        if (exception_setup(true))
+            q_free(stash[i].meta.l);
+        exception_cancel();
+    }
+    stash_cnt = kept;
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/* Write the queue to a snapshot file with q_save */
+static bool do_save(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!l_meta.l)
+        report(3, "Warning: Calling save on null queue");
+    error_check();
+
+    const char *path = file_path(argv[1]);
+    if (!path) {
+        report(1, "ERROR: Could not create temporary file");
+        return false;
+    }
+
+    bool ok = false;
+    if (exception_setup(true))
+        ok = q_save(l_meta.l, path);
+    exception_cancel();
+
+    if (!ok)
+        report(1, "ERROR: Could not save queue to %s", argv[1]);
+    else
+        report(2, "Saved %d elements to %s", l_meta.size, argv[1]);
+    return ok && !error_check();
+}
+
+/*
+ * Append the strings of a snapshot file to the queue with q_load, checking
+ * that the new elements are well-formed.
+ */
+static bool do_load(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!l_meta.l)
+        report(3, "Warning: Calling load on null queue");
+    error_check();
+
+    const char *path = file_path(argv[1]);
+    if (!path) {
+        report(1, "ERROR: Could not create temporary file");
+        return false;
+    }
+
+    struct list_head *last = l_meta.l ? l_meta.l->prev : NULL;
+    bool ok = false;
+    if (exception_setup(true))
+        ok = q_load(l_meta.l, path);
+    exception_cancel();
+
+    if (!ok) {
+        report(1, "ERROR: Could not load queue from %s", argv[1]);
+        return false;
+    }
+
+    int cnt = 0;
+    for (struct list_head *cur = last->next; cur != l_meta.l;
+         cur = cur->next) {
+        element_t *item = list_entry(cur, element_t, list);
+        if (!item->value ||
+            (q_keyed(l_meta.l) &&
+             strlen(item->value) != element_key(item)->len)) {
+            report(1, "ERROR: Loaded element has a bad string");
+            ok = false;
+            break;
+        }
+        cnt++;
+    }
+    lcnt += cnt;
+    l_meta.size += cnt;
+    report(2, "Loaded %d elements from %s", cnt, argv[1]);
+    if (q_size(l_meta.l) != l_meta.size) {
+        report(1, "ERROR: Queue size is %d after loading, expected %d",
+               q_size(l_meta.l), l_meta.size);
+        ok = false;
+    }
+
     show_queue(3);
     return ok && !error_check();
 }
@@ -901,6 +1927,9 @@ static bool do_shuffle(int argc, char *argv[])
     error_check();
 
     set_noallocate_mode(true);
+    /* The linear shuffle needs scratch space for a pointer per element */
+    if (!shuffle_inplace)
+        set_scratch_allowance(q_size(l_meta.l) * sizeof(struct list_head *));
     if (exception_setup(true))
         q_shuffle(l_meta.l);
     exception_cancel();
@@ -957,6 +1986,530 @@ static bool do_average_k(int argc, char *argv[])
     return !error_check();
 }
 
+static bool do_spsc_new(int argc, char *argv[])
+{
+    int cap = 1024;
+    if (argc > 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (argc == 2 && (!get_int(argv[1], &cap) || cap < 1)) {
+        report(1, "Invalid capacity '%s'", argv[1]);
+        return false;
+    }
+
+    size_t before = allocation_check();
+    spsc_free(ring);
+    ring_cnt = 0;
+    ring = spsc_new(cap);
+    ring_blocks += (long) allocation_check() - (long) before;
+    if (!ring) {
+        report(1, "ERROR: Could not allocate ring");
+        return false;
+    }
+    return !error_check();
+}
+
+static bool do_spsc_free(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+    if (!ring)
+        report(3, "Warning: Calling free on null ring");
+    size_t before = allocation_check();
+    spsc_free(ring);
+    ring_blocks += (long) allocation_check() - (long) before;
+    ring = NULL;
+    ring_cnt = 0;
+
+    bool ok = true;
+    if (ring_blocks) {
+        report(1, "ERROR: Freed ring, but %ld blocks are still allocated",
+               ring_blocks);
+        ring_blocks = 0;
+        ok = false;
+    }
+    return ok && !error_check();
+}
+
+static bool do_spsc_it(int argc, char *argv[])
+{
+    char randstr_buf[MAX_RANDSTR_LEN];
+    int reps = 1;
+    bool ok = true;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    if (argc == 3 && !get_int(argv[2], &reps)) {
+        report(1, "Invalid number of insertions '%s'", argv[2]);
+        return false;
+    }
+    if (!ring) {
+        report(1, "ERROR: Calling insert tail on null ring");
+        return false;
+    }
+
+    bool need_rand = !strcmp(argv[1], "RAND");
+    char *inserts = need_rand ? randstr_buf : argv[1];
+    for (int r = 0; ok && r < reps; r++) {
+        if (need_rand)
+            fill_rand_string(randstr_buf, sizeof(randstr_buf));
+        if (spsc_insert_tail(ring, inserts)) {
+            ring_cnt++;
+            continue;
+        }
+        fail_count++;
+        if (fail_count < fail_limit)
+            report(2, "Insertion of %s failed", inserts);
+        else {
+            report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                   inserts, fail_count);
+            ok = false;
+        }
+    }
+    report(3, "Ring holds %d strings", ring_cnt);
+    return ok && !error_check();
+}
+
+static bool do_spsc_rh(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (!ring) {
+        report(1, "ERROR: Calling remove head on null ring");
+        return false;
+    }
+
+    char removes[SPSC_SLOT];
+    bool ok = true;
+    if (spsc_remove_head(ring, removes, sizeof(removes))) {
+        ring_cnt--;
+        if (argc == 2 && strcmp(removes, argv[1])) {
+            report(1, "ERROR: Removed value %s != expected value %s", removes,
+                   argv[1]);
+            ok = false;
+        } else
+            report(2, "Removed %s from ring", removes);
+    } else if (ring_cnt) {
+        report(1, "ERROR: Ring of %d strings reported empty", ring_cnt);
+        ok = false;
+    } else {
+        fail_count++;
+        if (argc == 1 && fail_count < fail_limit)
+            report(2, "Removal from ring failed");
+        else {
+            report(1, "ERROR: Removal from ring failed (%d failures total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+    return ok && !error_check();
+}
+
+/* Create the priority queue in the layout new queues get */
+static bool do_pq_new(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    bool ok = true;
+    size_t before = allocation_check();
+    if (pq_cnt > big_list_size)
+        set_cautious_mode(false);
+    if (exception_setup(true)) {
+        q_pq_free(pq);
+        pq = q_pq_new(layout | (key_prefix ? Q_KEY_PREFIX : 0));
+    }
+    exception_cancel();
+    set_cautious_mode(true);
+    pq_blocks += (long) allocation_check() - (long) before;
+    pq_cnt = 0;
+    if (!pq) {
+        report(1, "ERROR: Could not allocate priority queue");
+        ok = false;
+    }
+    return ok && !error_check();
+}
+
+static bool do_pq_free(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+    if (!pq)
+        report(3, "Warning: Calling free on null priority queue");
+    error_check();
+
+    size_t before = allocation_check();
+    if (pq_cnt > big_list_size)
+        set_cautious_mode(false);
+    if (exception_setup(true))
+        q_pq_free(pq);
+    exception_cancel();
+    set_cautious_mode(true);
+    pq_blocks += (long) allocation_check() - (long) before;
+    pq = NULL;
+    pq_cnt = 0;
+
+    bool ok = true;
+    if (pq_blocks) {
+        report(1,
+               "ERROR: Freed priority queue, but %ld blocks are still "
+               "allocated",
+               pq_blocks);
+        pq_blocks = 0;
+        ok = false;
+    }
+    return ok && !error_check();
+}
+
+static bool do_pq_insert(int argc, char *argv[])
+{
+    if (simulation) {
+        if (argc != 1) {
+            report(1, "%s does not need arguments in simulation mode", argv[0]);
+            return false;
+        }
+        bool ok = is_pq_insert_const();
+        if (!ok) {
+            report(1, "ERROR: Probably not constant time");
+            return false;
+        }
+        report(1, "Probably constant time");
+        return ok;
+    }
+
+    char randstr_buf[MAX_RANDSTR_LEN];
+    int reps = 1;
+    bool ok = true;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    if (argc == 3 && !get_int(argv[2], &reps)) {
+        report(1, "Invalid number of insertions '%s'", argv[2]);
+        return false;
+    }
+    if (!pq) {
+        report(1, "ERROR: Calling insert on null priority queue");
+        return false;
+    }
+
+    bool need_rand = !strcmp(argv[1], "RAND");
+    char *inserts = need_rand ? randstr_buf : argv[1];
+    size_t before = allocation_check();
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r++) {
+            if (need_rand)
+                fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            if (q_pq_insert(pq, inserts)) {
+                pq_cnt++;
+                continue;
+            }
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %s failed", inserts);
+            else {
+                report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                       inserts, fail_count);
+                ok = false;
+            }
+        }
+    }
+    exception_cancel();
+    pq_blocks += (long) allocation_check() - (long) before;
+
+    if (q_pq_size(pq) != pq_cnt) {
+        report(1, "ERROR: Priority queue has %d strings, expected %d",
+               q_pq_size(pq), pq_cnt);
+        ok = false;
+    }
+    report(3, "Priority queue holds %d strings", pq_cnt);
+    return ok && !error_check();
+}
+
+/*
+ * Pop the smallest string, checking it against the optional expected value
+ * and against the new smallest string, which must not be smaller.
+ */
+static bool do_pq_pop(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s needs 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (!pq) {
+        report(1, "ERROR: Calling pop on null priority queue");
+        return false;
+    }
+
+    char *removes = malloc(string_length + 1);
+    if (!removes) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for removed strings");
+        return false;
+    }
+    removes[0] = '\0';
+
+    element_t *re = NULL;
+    size_t before = allocation_check();
+    if (exception_setup(true))
+        re = q_pq_pop(pq, removes, string_length + 1);
+    exception_cancel();
+
+    bool ok = true;
+    if (re) {
+        pq_cnt--;
+        element_t *next = q_pq_peek(pq);
+        if (strncmp(removes, re->value, string_length)) {
+            report(1, "ERROR: Failed to store removed value");
+            ok = false;
+        } else if (next && strcmp(next->value, re->value) < 0) {
+            report(1, "ERROR: Popped %s before smaller %s", re->value,
+                   next->value);
+            ok = false;
+        } else if (argc == 2 && strcmp(removes, argv[1])) {
+            report(1, "ERROR: Removed value %s != expected value %s", removes,
+                   argv[1]);
+            ok = false;
+        } else
+            report(2, "Removed %s from priority queue", removes);
+        /* Popped elements are anywhere in the block list, unlike removed ones */
+        if (pq_cnt > big_list_size)
+            set_cautious_mode(false);
+        q_release_element(re);
+        set_cautious_mode(true);
+        pq_blocks += (long) allocation_check() - (long) before;
+    } else if (pq_cnt) {
+        report(1, "ERROR: Priority queue of %d strings reported empty",
+               pq_cnt);
+        ok = false;
+    } else {
+        fail_count++;
+        if (argc == 1 && fail_count < fail_limit)
+            report(2, "Removal from priority queue failed");
+        else {
+            report(1,
+                   "ERROR: Removal from priority queue failed (%d failures "
+                   "total)",
+                   fail_count);
+            ok = false;
+        }
+    }
+
+    if (q_pq_size(pq) != pq_cnt) {
+        report(1, "ERROR: Priority queue has %d strings, expected %d",
+               q_pq_size(pq), pq_cnt);
+        ok = false;
+    }
+    free(removes);
+    return ok && !error_check();
+}
+
+#define MPMC_MAX_THREADS 64
+
+/* State shared by the threads of one mpmc stress run */
+typedef struct {
+    mpmc_t *q;
+    element_t **elems;
+    /* Elements [begin[p], begin[p + 1]) belong to producer p */
+    int begin[MPMC_MAX_THREADS + 1];
+    int producers, total;
+    /* Producers still running, and elements removed so far */
+    int producing, taken;
+    /* Times each element was removed, and removals out of producer order */
+    int *seen;
+    int reordered;
+} mpmc_stress_t;
+
+typedef struct {
+    mpmc_stress_t *st;
+    int id;
+} mpmc_worker_t;
+
+static void *mpmc_producer(void *arg)
+{
+    mpmc_worker_t *w = arg;
+    mpmc_stress_t *st = w->st;
+    for (int i = st->begin[w->id]; i < st->begin[w->id + 1]; i++) {
+        while (!mpmc_insert_tail(st->q, st->elems[i]))
+            sched_yield();
+    }
+    __atomic_fetch_sub(&st->producing, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *mpmc_consumer(void *arg)
+{
+    mpmc_stress_t *st = ((mpmc_worker_t *) arg)->st;
+    int last[MPMC_MAX_THREADS];
+    int reordered = 0;
+    for (int p = 0; p < st->producers; p++)
+        last[p] = -1;
+
+    while (__atomic_load_n(&st->taken, __ATOMIC_RELAXED) < st->total) {
+        element_t *e = mpmc_remove_head(st->q, NULL, 0);
+        if (!e) {
+            // Once every producer is done, an empty queue stays empty
+            if (!__atomic_load_n(&st->producing, __ATOMIC_ACQUIRE) &&
+                !(e = mpmc_remove_head(st->q, NULL, 0)))
+                break;
+            if (!e) {
+                sched_yield();
+                continue;
+            }
+        }
+        __atomic_fetch_add(&st->taken, 1, __ATOMIC_RELAXED);
+        int i = atoi(e->value);
+        if (i < 0 || i >= st->total)
+            continue;
+        __atomic_fetch_add(&st->seen[i], 1, __ATOMIC_RELAXED);
+        // A FIFO queue hands out each producer's elements in order
+        int p = 0;
+        while (i >= st->begin[p + 1])
+            p++;
+        if (i < last[p])
+            reordered++;
+        last[p] = i;
+    }
+    __atomic_fetch_add(&st->reordered, reordered, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static bool do_mpmc(int argc, char *argv[])
+{
+    int args[4] = {2, 2, 100000, 1024};
+    if (argc > 5) {
+        report(1, "%s needs 0-4 arguments", argv[0]);
+        return false;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (!get_int(argv[i], &args[i - 1]) || args[i - 1] < 1) {
+            report(1, "Invalid number '%s'", argv[i]);
+            return false;
+        }
+    }
+    int producers = args[0], consumers = args[1], total = args[2];
+    if (producers > MPMC_MAX_THREADS || consumers > MPMC_MAX_THREADS) {
+        report(1, "At most %d producers and %d consumers", MPMC_MAX_THREADS,
+               MPMC_MAX_THREADS);
+        return false;
+    }
+
+    // Elements are allocated up front, the harness allocator is not
+    // thread-safe
+    mpmc_stress_t st = {
+        .producers = producers,
+        .producing = producers,
+        .total = total,
+    };
+    struct list_head *src = q_new();
+    st.q = mpmc_new(args[3]);
+    st.elems = malloc(total * sizeof(*st.elems));
+    st.seen = calloc(total, sizeof(*st.seen));
+    bool ok = src && st.q && st.elems && st.seen;
+    for (int i = 0; ok && i < total; i++) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", i);
+        ok = q_insert_tail(src, buf);
+        if (ok)
+            st.elems[i] = q_remove_head(src, NULL, 0);
+        else
+            total = i;
+    }
+    q_free(src);
+    if (!ok) {
+        report(1, "ERROR: Could not allocate the elements");
+        for (int i = 0; st.elems && i < total; i++)
+            q_release_element(st.elems[i]);
+        mpmc_free(st.q);
+        free(st.elems);
+        free(st.seen);
+        return false;
+    }
+    for (int p = 0; p <= producers; p++)
+        st.begin[p] = (long) total * p / producers;
+
+    pthread_t tids[2 * MPMC_MAX_THREADS];
+    mpmc_worker_t workers[2 * MPMC_MAX_THREADS];
+    int n = 0;
+    double start;
+    init_time(&start);
+    // Consumers start first, producers only if all consumers are running
+    for (int i = 0; i < consumers; i++) {
+        workers[n] = (mpmc_worker_t){.st = &st, .id = i};
+        if (!pthread_create(&tids[n], NULL, mpmc_consumer, &workers[n]))
+            n++;
+    }
+    for (int i = 0; i < producers; i++) {
+        workers[n] = (mpmc_worker_t){.st = &st, .id = i};
+        if (n < consumers + i ||
+            pthread_create(&tids[n], NULL, mpmc_producer, &workers[n]))
+            __atomic_fetch_sub(&st.producing, 1, __ATOMIC_RELEASE);
+        else
+            n++;
+    }
+    for (int i = 0; i < n; i++)
+        pthread_join(tids[i], NULL);
+    double elapsed = delta_time(&start);
+
+    if (n < producers + consumers) {
+        report(1, "ERROR: Could only start %d of %d threads", n,
+               producers + consumers);
+        ok = false;
+    } else {
+        int lost = 0, duplicated = 0;
+        for (int i = 0; i < total; i++) {
+            lost += !st.seen[i];
+            duplicated += st.seen[i] > 1;
+        }
+        report(1,
+               "%d elements, %d producers, %d consumers: %.3f s, "
+               "%.2f M elements/s",
+               total, producers, consumers, elapsed,
+               elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+        if (lost || duplicated || st.reordered) {
+            report(1,
+                   "ERROR: %d elements lost, %d duplicated, %d out of "
+                   "producer order",
+                   lost, duplicated, st.reordered);
+            ok = false;
+        }
+    }
+
+    // Elements left behind are released below along with the others
+    while (mpmc_remove_head(st.q, NULL, 0))
+        ;
+    if (total > big_list_size)
+        set_cautious_mode(false);
+    for (int i = 0; i < total; i++)
+        q_release_element(st.elems[i]);
+    set_cautious_mode(true);
+    mpmc_free(st.q);
+    free(st.elems);
+    free(st.seen);
+    return ok && !error_check();
+}
+
+/* Measure constant time in simulation mode on queues like do_new creates */
+static void set_dut_layout(int oldval)
+{
+    dut_layout = layout | (key_prefix ? Q_KEY_PREFIX : 0);
+}
+
+static void set_shuffle_seed(int oldval)
+{
+    q_shuffle_seed(shuffle_seed);
+}
+
 static void console_init()
 {
     ADD_COMMAND(new, "                | Create new queue");
@@ -977,22 +2530,91 @@ static void console_init()
         rt,
         " [str]          | Remove from tail of queue.  Optionally compare "
         "to expected value str");
+    ADD_COMMAND(ih_take,
+                " str            | Insert a heap copy of str at head of "
+                "queue, handing it over without another copy");
+    ADD_COMMAND(it_take,
+                " str            | Insert a heap copy of str at tail of "
+                "queue, handing it over without another copy");
+    ADD_COMMAND(rh_take,
+                " [str]          | Remove from head of queue, taking its "
+                "string.  Optionally compare to expected value str");
+    ADD_COMMAND(rt_take,
+                " [str]          | Remove from tail of queue, taking its "
+                "string.  Optionally compare to expected value str");
+    ADD_COMMAND(rh_bulk,
+                " n [size]       | Remove n elements from head of queue at "
+                "once, copying strings into a buffer of size bytes");
+    ADD_COMMAND(rt_bulk,
+                " n [size]       | Remove n elements from tail of queue at "
+                "once, copying strings into a buffer of size bytes");
     ADD_COMMAND(
         rhq,
         "                | Remove from head of queue without reporting value.");
     ADD_COMMAND(reverse, "                | Reverse queue");
     ADD_COMMAND(sort, "                | Sort queue in ascending order");
     ADD_COMMAND(kernel_sort, "        | Sort queue using kernel list_sort");
+    ADD_COMMAND(sort_external,
+                " [file]         | Sort queue through temporary files within "
+                "ext_budget bytes, into file if given. File TMP is as for "
+                "save");
     ADD_COMMAND(
         size, " [n]            | Compute queue size n times (default: n == 1)");
     ADD_COMMAND(show, "                | Show queue contents");
     ADD_COMMAND(dm, "                | Delete middle node in queue");
+    ADD_COMMAND(pm,
+                " [str]          | Show middle node of queue.  Optionally "
+                "compare to expected value str");
     ADD_COMMAND(
         dedup, "                | Delete all nodes that have duplicate string");
+    ADD_COMMAND(dedup_unsorted,
+                "     | Delete all nodes that have duplicate string, in any "
+                "order");
+    ADD_COMMAND(stash,
+                " name           | Set the queue aside as name, leaving no "
+                "current queue");
+    ADD_COMMAND(unstash,
+                " name           | Make the queue stashed as name current "
+                "again");
+    ADD_COMMAND(merge,
+                " name ...       | Merge the sorted queue with the named "
+                "sorted stashed queues, which are then deleted");
+    ADD_COMMAND(save,
+                " file           | Save queue to snapshot file, or to a "
+                "temporary file of this run if file equals TMP");
+    ADD_COMMAND(load,
+                " file           | Append the strings of snapshot file to "
+                "queue, without copying them. File TMP is as for save");
     ADD_COMMAND(swap,
                 "                | Swap every two adjacent nodes in queue");
     ADD_COMMAND(shuffle, "                | Shuffle the queue");
     ADD_COMMAND(average_k, "                | Experiment K");
+    ADD_COMMAND(spsc_new,
+                " [cap]          | Create ring buffer of cap slots (default: "
+                "1024)");
+    ADD_COMMAND(spsc_it,
+                " str [n]        | Insert string str at tail of ring n times. "
+                "Generate random string(s) if str equals RAND. (default: n == "
+                "1)");
+    ADD_COMMAND(spsc_rh,
+                " [str]          | Remove from head of ring.  Optionally "
+                "compare to expected value str");
+    ADD_COMMAND(spsc_free, "                | Delete ring buffer");
+    ADD_COMMAND(pq_new,
+                "                | Create priority queue in the layout of "
+                "new queues");
+    ADD_COMMAND(pq_insert,
+                " str [n]        | Insert string str into priority queue n "
+                "times. Generate random string(s) if str equals RAND. "
+                "(default: n == 1)");
+    ADD_COMMAND(pq_pop,
+                " [str]          | Remove smallest string from priority "
+                "queue.  Optionally compare to expected value str");
+    ADD_COMMAND(pq_free, "                | Delete priority queue");
+    ADD_COMMAND(mpmc,
+                " [p c n cap]    | Pass n elements from p producer to c "
+                "consumer threads through a lock-free queue of capacity cap "
+                "(default: 2 2 100000 1024)");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
@@ -1000,6 +2622,35 @@ static void console_init()
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
     add_param("cmp_count", &cmp_count, "Number of times compare called", NULL);
+    add_param("sort_engine", &sort_engine,
+              "Algorithm used by sort "
+              "(0: merge, 1: radix, 2: array, 3: parallel, 4: natural)",
+              NULL);
+    add_param("sort_threads", &sort_threads,
+              "Number of threads used by parallel sort", NULL);
+    add_param("sort_cutoff", &sort_serial_cutoff,
+              "Smallest queue sorted by more than one thread", NULL);
+    add_param("cmp_kernel", &cmp_kernel,
+              "String compare used by sort and dedup (0: strcmp, 1: simd)",
+              NULL);
+    add_param("dedup_check", &dedup_check,
+              "Check dedup against a copy of the queue (0) or hashes of its "
+              "runs of equal strings (1)",
+              NULL);
+    add_param("ext_budget", &ext_budget,
+              "Bytes of memory sort_external may allocate", NULL);
+    add_param("shuffle_seed", &shuffle_seed,
+              "Seed the shuffle generator for repeatable shuffles",
+              set_shuffle_seed);
+    add_param("shuffle_inplace", &shuffle_inplace,
+              "Shuffle in O(n log n) time without scratch memory", NULL);
+    add_param("prefix", &key_prefix,
+              "Cache 8-byte key prefixes in elements of new queues",
+              set_dut_layout);
+    add_param("layout", &layout,
+              "Element layout of new queues "
+              "(0: malloc, 1: pool, 2: inline, 3: sso, 4: intern, 5: arena)",
+              set_dut_layout);
 }
 
 /* Signal handlers */
@@ -1030,13 +2681,27 @@ static void queue_init()
 static bool queue_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (lcnt > big_list_size)
+    if (lcnt > big_list_size || pq_cnt > big_list_size)
         set_cautious_mode(false);
 
-    if (exception_setup(true))
+    if (exception_setup(true)) {
         q_free(l_meta.l);
+        for (int i = 0; i < stash_cnt; i++)
+            q_free(stash[i].meta.l);
+        q_pq_free(pq);
+    }
     exception_cancel();
     set_cautious_mode(true);
+    stash_cnt = 0;
+    pq = NULL;
+    pq_blocks = 0;
+    spsc_free(ring);
+    ring = NULL;
+    ring_blocks = 0;
+    if (tmp_path[0]) {
+        unlink(tmp_path);
+        tmp_path[0] = '\0';
+    }
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -1414,11 +3079,23 @@ __attribute__((nonnull(2, 3))) void list_sort(void *priv,
     merge_final(priv, cmp, head, pending, list);
 }
 
+/*
+ * priv is non-NULL when the elements carry keys, whose prefixes then decide
+ * the comparison unless they are equal.
+ */
 int my_cmp(void *priv, const struct list_head *a, const struct list_head *b)
 {
+    const element_t *ea = list_entry(a, element_t, list);
+    const element_t *eb = list_entry(b, element_t, list);
     cmp_count++;
-    return strcmp(list_entry(a, element_t, list)->value,
-                  list_entry(b, element_t, list)->value);
+    if (priv && element_key(ea)->prefix != element_key(eb)->prefix)
+        return element_key(ea)->prefix < element_key(eb)->prefix ? -1 : 1;
+    if (cmp_kernel == Q_CMP_SIMD) {
+        size_t la = priv ? element_key(ea)->len : strlen(ea->value);
+        size_t lb = priv ? element_key(eb)->len : strlen(eb->value);
+        return strcmp_simd(ea->value, la, eb->value, lb);
+    }
+    return strcmp(ea->value, eb->value);
 }
 
 double average_K(int size, int kernel)
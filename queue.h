@@ -10,6 +10,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "list.h"
 
 /* Linked list element */
@@ -19,8 +20,46 @@ typedef struct {
      */
     char *value;
     struct list_head list;
+    /* Allocator owning the storage of this element.
+     * NULL if the element and its string were allocated separately.
+     */
+    struct q_alloc *alloc;
 } element_t;
 
+/*
+ * Sort key of an element of a queue created with Q_KEY_PREFIX, stored right
+ * after its element_t. Elements of other queues have no room for it.
+ */
+typedef struct {
+    /* First 8 bytes of value, big-endian, zero-padded */
+    uint64_t prefix;
+    /* Length of value, excluding the null terminator */
+    size_t len;
+} element_key_t;
+
+/* Key of element e, which must be an element of a keyed queue */
+static inline element_key_t *element_key(const element_t *e)
+{
+    return (element_key_t *) (e + 1);
+}
+
+/* Storage layouts of queue elements, selected by q_new_layout() */
+enum {
+    Q_LAYOUT_MALLOC, /* element_t and string are separate malloc blocks */
+    Q_LAYOUT_POOL,   /* element_t is carved from slabs owned by the queue */
+    Q_LAYOUT_INLINE, /* string is stored right after element_t, one block */
+    Q_LAYOUT_SSO,    /* short strings inline in the node, long ones apart */
+    Q_LAYOUT_INTERN, /* equal strings share one reference-counted copy */
+    Q_LAYOUT_ARENA,  /* nodes are slots of blocks, allocated in queue order */
+};
+
+/*
+ * Flag or-ed into the layout given to q_new_layout(): store an element_key_t
+ * after each element at insert time, so sorting and q_delete_dup() can
+ * decide most comparisons without reading the strings.
+ */
+#define Q_KEY_PREFIX 0x100
+
 /* Operations on queue */
 
 /*
@@ -29,6 +68,13 @@ typedef struct {
  */
 struct list_head *q_new();
 
+/*
+ * Create empty queue whose elements are stored in the given layout.
+ * q_new() is the same as q_new_layout(Q_LAYOUT_MALLOC).
+ * Return NULL if could not allocate space or layout is unknown.
+ */
+struct list_head *q_new_layout(int layout);
+
 /*
  * Free ALL storage used by queue.
  * No effect if q is NULL
@@ -53,6 +99,65 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/* Length argument of q_insert_*_take telling them to compute it */
+#define Q_LEN_UNKNOWN ((size_t) -1)
+
+/*
+ * Attempt to insert element at head of queue, adopting string s instead of
+ * copying it. s must have been allocated with malloc and len is its length,
+ * excluding the null terminator, or Q_LEN_UNKNOWN.
+ * Return true if successful, after which s belongs to the queue and is freed
+ * with the element.
+ * Return false if q is NULL or could not allocate space, in which case s
+ * still belongs to the caller.
+ */
+bool q_insert_head_take(struct list_head *head, char *s, size_t len);
+
+/*
+ * Attempt to insert element at tail of queue, adopting string s.
+ * Other attribute is as same as q_insert_head_take.
+ */
+bool q_insert_tail_take(struct list_head *head, char *s, size_t len);
+
+/*
+ * Attempt to insert n strings at head of queue, as if q_insert_head() were
+ * called for s[0], s[1], ..., s[n - 1] in turn, so s[n - 1] ends up first.
+ * The new elements are linked in with a single splice. For the malloc
+ * layout, elements and strings come from a few large blocks, each freed
+ * once all the elements it holds have been released.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space, in which case no
+ * string is inserted.
+ */
+bool q_insert_head_bulk(struct list_head *head, char **s, size_t n);
+
+/*
+ * Attempt to insert n strings at tail of queue, as if q_insert_tail() were
+ * called for s[0], s[1], ..., s[n - 1] in turn.
+ * Other attribute is as same as q_insert_head_bulk.
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **s, size_t n);
+
+/*
+ * Write the strings of queue, in order, to a snapshot file at path.
+ * An existing file is replaced, not rewritten, so elements already loaded
+ * from it stay valid.
+ * Return true if successful.
+ * Return false if q is NULL or the file could not be written.
+ */
+bool q_save(struct list_head *head, const char *path);
+
+/*
+ * Append the strings of the snapshot file at path, written by q_save, to
+ * the tail of queue. The file is mapped into memory and the new elements
+ * point into the mapping instead of holding copies; it is unmapped once all
+ * of them have been released.
+ * Return true if successful.
+ * Return false if q is NULL, or the file could not be mapped or is not a
+ * valid snapshot, in which case the queue is unchanged.
+ */
+bool q_load(struct list_head *head, const char *path);
+
 /*
  * Attempt to remove element from head of queue.
  * Return target element.
@@ -75,17 +180,88 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/*
+ * Attempt to remove element from head of queue and free it, handing its
+ * string over to the caller, who must free it.
+ * Return the string, and store its length in *len if len is non-NULL.
+ * Return NULL if queue is NULL or empty, or could not allocate space, in
+ * which case the queue is unchanged.
+ * The string is not copied if the element kept it in a block of its own,
+ * which is always the case for elements inserted by q_insert_*_take;
+ * strings stored inside nodes or shared by several elements are copied.
+ */
+char *q_remove_head_take(struct list_head *head, size_t *len);
+
+/*
+ * Attempt to remove element from tail of queue, handing its string over.
+ * Other attribute is as same as q_remove_head_take.
+ */
+char *q_remove_tail_take(struct list_head *head, size_t *len);
+
+/*
+ * Attempt to remove up to k elements from head of queue at once.
+ * The removed elements are appended to list, a list_head initialized by the
+ * caller, in the order they had in the queue.
+ * Return the number of elements removed.
+ * Return 0 if q is NULL or empty.
+ * If buf is non-NULL, the removed strings are also copied, null-terminated
+ * and back to back, into buf, and if offsets is non-NULL the i-th of them
+ * starts at buf + offsets[i]. Removal then stops before the first element
+ * whose string does not fit in what is left of the bufsize bytes of buf.
+ *
+ * As with q_remove_head, the elements are unlinked, not freed; they can be
+ * released all together with q_release_list.
+ */
+size_t q_remove_head_bulk(struct list_head *head,
+                          struct list_head *list,
+                          size_t k,
+                          char *buf,
+                          size_t bufsize,
+                          size_t *offsets);
+
+/*
+ * Attempt to remove up to k elements from tail of queue at once.
+ * The last k elements of the queue are appended to list, still in queue
+ * order, so the tail of the queue ends up last.
+ * Other attribute is as same as q_remove_head_bulk.
+ */
+size_t q_remove_tail_bulk(struct list_head *head,
+                          struct list_head *list,
+                          size_t k,
+                          char *buf,
+                          size_t bufsize,
+                          size_t *offsets);
+
 /*
  * Attempt to release element.
+ * Elements from a pooled queue are recycled by the queue they came from,
+ * which may already have been freed.
  */
 void q_release_element(element_t *e);
 
+/*
+ * Release every element of list, such as one filled by q_remove_head_bulk,
+ * leaving list empty.
+ * No effect if list is NULL.
+ */
+void q_release_list(struct list_head *list);
+
 /*
  * Return number of elements in queue.
  * Return 0 if q is NULL or empty
+ * The count is cached by the queue, so this takes constant time.
  */
 int q_size(struct list_head *head);
 
+/*
+ * Move all elements of queue list to the beginning (q_splice) or the end
+ * (q_splice_tail) of queue head, leaving list empty.
+ * Both must have been created by q_new(). Use these instead of list_splice*
+ * so the element counts of both queues stay correct.
+ */
+void q_splice(struct list_head *head, struct list_head *list);
+void q_splice_tail(struct list_head *head, struct list_head *list);
+
 /*
  * Delete the middle node in list.
  * The middle node of a linked list of size n is the
@@ -98,6 +274,32 @@ int q_size(struct list_head *head);
  */
 bool q_delete_mid(struct list_head *head);
 
+/*
+ * Return the middle element of queue, as defined by q_delete_mid(),
+ * without removing it.
+ * Return NULL if queue is NULL or empty.
+ *
+ * The queue tracks its middle node, so this and q_delete_mid() usually take
+ * constant time. After sorting, shuffling or deleting duplicates, the next
+ * call walks half the queue once to find the middle again.
+ */
+element_t *q_peek_mid(struct list_head *head);
+
+/*
+ * Tell the queue its nodes were rearranged directly with list.h functions
+ * (such as list_sort), so state depending on node positions is recomputed.
+ * The set of nodes must not have changed.
+ */
+void q_list_changed(struct list_head *head);
+
+/*
+ * Return whether every element of queue has an element_key_t.
+ * True for a queue created with Q_KEY_PREFIX until q_splice(),
+ * q_splice_tail() or q_merge() move elements without keys into it.
+ * Return false if q is NULL.
+ */
+bool q_keyed(struct list_head *head);
+
 /*
  * Delete all nodes that have duplicate string,
  * leaving only distinct strings from the original list.
@@ -108,6 +310,16 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/*
+ * Delete all nodes that have duplicate string like q_delete_dup(), without
+ * requiring the queue to be sorted. The order of the remaining nodes is kept.
+ * Runs in expected linear time using a temporary hash table.
+ * Return true if successful.
+ * Return false if list is NULL or empty, or the table could not be allocated,
+ * in which case the queue is left unchanged.
+ */
+bool q_delete_dup_unsorted(struct list_head *head);
+
 /*
  * Attempt to swap every two adjacent nodes.
  *
@@ -124,11 +336,110 @@ void q_swap(struct list_head *head);
  */
 void q_reverse(struct list_head *head);
 
+/*
+ * String comparison kernels for q_sort() and q_delete_dup(), selected by
+ * the global cmp_kernel. Q_CMP_SIMD compares vectors of bytes using the
+ * lengths in the element keys, or measured with strlen() in queues without
+ * keys, see strcmp_simd.h.
+ */
+enum {
+    Q_CMP_STRCMP,
+    Q_CMP_SIMD,
+};
+
+/* Algorithms q_sort() can use, selected by the global sort_engine */
+enum {
+    Q_SORT_MERGE,    /* bottom-up merge sort with strcmp */
+    Q_SORT_RADIX,    /* MSD radix sort on bytes, merge sort for small buckets */
+    Q_SORT_ARRAY,    /* sort an array of element pointers, then relink */
+    Q_SORT_PARALLEL, /* merge sort segments on sort_threads threads */
+    Q_SORT_NATURAL,  /* merge natural runs, linear on (reverse) sorted input */
+};
+
 /*
  * Sort elements of queue in ascending order
  * No effect if q is NULL or empty. In addition, if q has only one
  * element, do nothing.
+ * The sort is stable whichever engine is selected.
+ * Q_SORT_ARRAY allocates scratch space for 2 * q_size(head) pointers.
  */
 void q_sort(struct list_head *head);
 
+/*
+ * Merge k queues, each sorted in ascending order, into queues[0], leaving
+ * the other queues empty but not freed. NULL entries are skipped; the
+ * queues must otherwise be distinct.
+ * The merge is stable: equal strings keep their order within a queue, and
+ * those of an earlier queue come first. Nodes are relinked, not copied,
+ * through a loser tree in O(n log k) comparisons, without allocating.
+ * Return the number of elements in queues[0] afterwards.
+ * Return 0 if queues or queues[0] is NULL.
+ */
+int q_merge(struct list_head **queues, int k);
+
+/*
+ * Sort queue in ascending order through temporary files, for queues whose
+ * strings do not fit in memory at once.
+ * Runs that fit in budget bytes are sorted in memory, spilled to temporary
+ * files and merged back in passes of up to 64 runs. Apart from the stdio
+ * streams, at most budget bytes are allocated at a time, besides the nodes
+ * of the sorted queue. The sort is stable.
+ * If path is not NULL, the sorted strings are written to path as a snapshot
+ * (see q_save) and the queue is left empty; otherwise they are loaded back
+ * into the queue as q_load does.
+ * Return true if successful.
+ * Return false if q is NULL, if budget is too small for the longest string,
+ * or on an I/O error, leaving the strings in the queue in their original
+ * order.
+ */
+bool q_sort_external(struct list_head *head, size_t budget, const char *path);
+
+/*
+ * Priority queue of strings: a pairing heap whose nodes are the element_t of
+ * a queue in any layout, popped in ascending order of their strings.
+ * Popped elements are released with q_release_element() like removed ones.
+ */
+typedef struct q_pq q_pq_t;
+
+/*
+ * Create empty priority queue whose elements are stored in the given
+ * layout, as for q_new_layout().
+ * Return NULL if could not allocate space or layout is unknown.
+ */
+q_pq_t *q_pq_new(int layout);
+
+/*
+ * Free all storage used by priority queue.
+ * No effect if pq is NULL.
+ */
+void q_pq_free(q_pq_t *pq);
+
+/*
+ * Attempt to insert a copy of string s into priority queue, in O(1) time.
+ * Return true if successful.
+ * Return false if pq is NULL or could not allocate space.
+ */
+bool q_pq_insert(q_pq_t *pq, char *s);
+
+/*
+ * Return the element with the smallest string, leaving it in place.
+ * Return NULL if pq is NULL or empty.
+ */
+element_t *q_pq_peek(q_pq_t *pq);
+
+/*
+ * Attempt to remove the element with the smallest string, in O(log n)
+ * amortized time. Equal strings come out in no particular order.
+ * If sp is non-NULL, the removed string is copied to *sp as by
+ * q_remove_head().
+ * Return the removed element, or NULL if pq is NULL or empty.
+ */
+element_t *q_pq_pop(q_pq_t *pq, char *sp, size_t bufsize);
+
+/*
+ * Return number of elements in priority queue.
+ * Return 0 if pq is NULL.
+ */
+int q_pq_size(q_pq_t *pq);
+
 #endif /* LAB0_QUEUE_H */
@@ -35,7 +35,33 @@ class Tracer:
         14: "trace-14-perf",
         15: "trace-15-perf",
         16: "trace-16-perf",
-        17: "trace-17-complexity"
+        17: "trace-17-complexity",
+        18: "trace-18-external",
+        19: "trace-19-pq",
+        20: "trace-20-intern-dedup",
+        21: "trace-21-merge",
+        22: "trace-22-pool",
+        23: "trace-23-inline",
+        24: "trace-24-sso",
+        25: "trace-25-size",
+        26: "trace-26-intern",
+        27: "trace-27-radix",
+        28: "trace-28-array",
+        29: "trace-29-parallel",
+        30: "trace-30-natural",
+        31: "trace-31-prefix",
+        32: "trace-32-simd",
+        33: "trace-33-middle",
+        34: "trace-34-shuffle",
+        35: "trace-35-arena",
+        36: "trace-36-mpmc",
+        37: "trace-37-spsc",
+        38: "trace-38-bulk",
+        39: "trace-39-take",
+        40: "trace-40-dedup-check",
+        41: "trace-41-save",
+        42: "trace-42-resave",
+        43: "trace-43-held"
     }
 
     traceProbs = {
@@ -55,10 +81,39 @@ class Tracer:
         14: "Trace-14",
         15: "Trace-15",
         16: "Trace-16",
-        17: "Trace-17"
+        17: "Trace-17",
+        18: "Trace-18",
+        19: "Trace-19",
+        20: "Trace-20",
+        21: "Trace-21",
+        22: "Trace-22",
+        23: "Trace-23",
+        24: "Trace-24",
+        25: "Trace-25",
+        26: "Trace-26",
+        27: "Trace-27",
+        28: "Trace-28",
+        29: "Trace-29",
+        30: "Trace-30",
+        31: "Trace-31",
+        32: "Trace-32",
+        33: "Trace-33",
+        34: "Trace-34",
+        35: "Trace-35",
+        36: "Trace-36",
+        37: "Trace-37",
+        38: "Trace-38",
+        39: "Trace-39",
+        40: "Trace-40",
+        41: "Trace-41",
+        42: "Trace-42",
+        43: "Trace-43"
     }
 
-    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
+    maxScores = [
+        0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 6, 5, 6, 6, 6, 6,
+        6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6
+    ]
 
     RED = '\033[91m'
     GREEN = '\033[92m'
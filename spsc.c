@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "spsc.h"
+
+#define CACHE_LINE 64
+
+/*
+ * Each index shares a cache line only with the copy of the other index
+ * cached by the same side, so the producer and the consumer never write to
+ * the same line. The groups are kept apart by a whole line of padding
+ * rather than by aligning them, which malloc() could not honor.
+ */
+struct spsc {
+    /* Consumer side: next slot to read, and last tail it saw */
+    size_t head;
+    size_t tail_seen;
+    char pad1[CACHE_LINE];
+    /* Producer side: next slot to write, and last head it saw */
+    size_t tail;
+    size_t head_seen;
+    char pad2[CACHE_LINE];
+    /* Read-only after creation */
+    size_t mask;
+    char (*slots)[SPSC_SLOT];
+};
+
+spsc_t *spsc_new(size_t capacity)
+{
+    size_t cap = 1;
+    while (cap < capacity)
+        cap <<= 1;
+
+    spsc_t *r = malloc(sizeof(*r));
+    if (!r)
+        return NULL;
+    if (!(r->slots = malloc(cap * SPSC_SLOT))) {
+        free(r);
+        return NULL;
+    }
+    r->head = r->tail_seen = 0;
+    r->tail = r->head_seen = 0;
+    r->mask = cap - 1;
+    return r;
+}
+
+void spsc_free(spsc_t *r)
+{
+    if (!r)
+        return;
+    free(r->slots);
+    free(r);
+}
+
+bool spsc_insert_tail(spsc_t *r, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (n > SPSC_SLOT)
+        return false;
+
+    size_t tail = r->tail;
+    if (tail - r->head_seen > r->mask) {
+        r->head_seen = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (tail - r->head_seen > r->mask)
+            return false;
+    }
+    memcpy(r->slots[tail & r->mask], s, n);
+    /* Publish the slot contents together with the new tail */
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool spsc_remove_head(spsc_t *r, char *sp, size_t bufsize)
+{
+    size_t head = r->head;
+    if (head == r->tail_seen) {
+        r->tail_seen = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (head == r->tail_seen)
+            return false;
+    }
+    if (sp && bufsize) {
+        strncpy(sp, r->slots[head & r->mask], bufsize);
+        sp[bufsize - 1] = '\0';
+    }
+    /* The slot may be overwritten once the producer sees the new head */
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
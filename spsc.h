@@ -0,0 +1,48 @@
+#ifndef LAB0_SPSC_H
+#define LAB0_SPSC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of a ring slot; strings up to SPSC_SLOT - 1 bytes fit */
+#define SPSC_SLOT 64
+
+/*
+ * Bounded ring buffer for exactly one producer thread and one consumer
+ * thread. Strings are copied into fixed-size slots of the ring, so neither
+ * side allocates. Each side only writes its own index and publishes it with
+ * a release store, read by the other side with an acquire load; each side
+ * also caches the other's index, so it touches the shared cache line only
+ * when the ring looks full or empty. Every operation finishes in a bounded
+ * number of steps whatever the other thread does (wait-free).
+ *
+ * The producer side mirrors q_insert_tail() and the consumer side mirrors
+ * q_remove_head(), except that the removed string is only copied out, as
+ * there is no element to return.
+ */
+typedef struct spsc spsc_t;
+
+/*
+ * Create an empty ring of capacity slots, rounded up to a power of two.
+ * Return NULL if could not allocate space.
+ */
+spsc_t *spsc_new(size_t capacity);
+
+/* Free all storage used by the ring. No effect if r is NULL */
+void spsc_free(spsc_t *r);
+
+/*
+ * Copy string s to the tail of the ring. Producer side only.
+ * Return false if the ring is full or s does not fit in a slot.
+ */
+bool spsc_insert_tail(spsc_t *r, const char *s);
+
+/*
+ * Remove the string at the head of the ring. Consumer side only.
+ * If sp is non-NULL, copy the string to *sp (up to a maximum of bufsize-1
+ * characters, plus a null terminator).
+ * Return false if the ring is empty.
+ */
+bool spsc_remove_head(spsc_t *r, char *sp, size_t bufsize);
+
+#endif /* LAB0_SPSC_H */
@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#include "strcmp_simd.h"
+
+typedef int (*kernel_t)(const char *, size_t, const char *, size_t);
+
+static inline int byte_diff(const char *a, const char *b, size_t i)
+{
+    return (unsigned char) a[i] - (unsigned char) b[i];
+}
+
+static inline int length_diff(size_t la, size_t lb)
+{
+    return la < lb ? -1 : la > lb;
+}
+
+/*
+ * Finish a comparison from offset i, where fewer than a vector of common
+ * bytes remain: 8-byte words first, then single bytes.
+ */
+static inline int cmp_tail(const char *a,
+                           size_t la,
+                           const char *b,
+                           size_t lb,
+                           size_t i)
+{
+    size_t n = la < lb ? la : lb;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t wa, wb;
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        if (wa == wb)
+            continue;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return byte_diff(a, b, i + __builtin_ctzll(wa ^ wb) / 8);
+#else
+        return byte_diff(a, b, i + __builtin_clzll(wa ^ wb) / 8);
+#endif
+    }
+    for (; i < n; i++) {
+        if (a[i] != b[i])
+            return byte_diff(a, b, i);
+    }
+    return length_diff(la, lb);
+}
+
+#ifdef HAVE_X86_SIMD
+/* 16 bytes per step, checked 64 at a time while the strings agree */
+static int cmp_sse2(const char *a, size_t la, const char *b, size_t lb)
+{
+    size_t n = la < lb ? la : lb, i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+                                    _mm_loadu_si128((const __m128i *) (b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *) (a + i + 16)),
+            _mm_loadu_si128((const __m128i *) (b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *) (a + i + 32)),
+            _mm_loadu_si128((const __m128i *) (b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *) (a + i + 48)),
+            _mm_loadu_si128((const __m128i *) (b + i + 48)));
+        __m128i eq =
+            _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+        if (_mm_movemask_epi8(eq) != 0xffff)
+            break;
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        uint32_t neq = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xffff;
+        if (neq)
+            return byte_diff(a, b, i + __builtin_ctz(neq));
+    }
+    return cmp_tail(a, la, b, lb, i);
+}
+
+/* 32 bytes per step, checked 64 at a time while the strings agree */
+__attribute__((target("avx2"))) static int cmp_avx2(const char *a,
+                                                    size_t la,
+                                                    const char *b,
+                                                    size_t lb)
+{
+    size_t n = la < lb ? la : lb, i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m256i e0 = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *) (a + i)),
+            _mm256_loadu_si256((const __m256i *) (b + i)));
+        __m256i e1 = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *) (a + i + 32)),
+            _mm256_loadu_si256((const __m256i *) (b + i + 32)));
+        if ((uint32_t) _mm256_movemask_epi8(_mm256_and_si256(e0, e1)) !=
+            0xffffffffu)
+            break;
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+        uint32_t neq =
+            ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        if (neq)
+            return byte_diff(a, b, i + __builtin_ctz(neq));
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        uint32_t neq = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xffff;
+        if (neq)
+            return byte_diff(a, b, i + __builtin_ctz(neq));
+    }
+    return cmp_tail(a, la, b, lb, i);
+}
+#endif
+
+/* Word-at-a-time fallback for targets without a vector kernel */
+static int cmp_words(const char *a, size_t la, const char *b, size_t lb)
+{
+    return cmp_tail(a, la, b, lb, 0);
+}
+
+/* Kernel picked for this CPU before main() runs */
+static kernel_t kernel = cmp_words;
+
+__attribute__((constructor)) static void select_kernel(void)
+{
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    kernel = __builtin_cpu_supports("avx2") ? cmp_avx2 : cmp_sse2;
+#endif
+}
+
+int strcmp_simd(const char *a, size_t la, const char *b, size_t lb)
+{
+    return kernel(a, la, b, lb);
+}
+
+int strcmp_scalar(const char *a, size_t la, const char *b, size_t lb)
+{
+    size_t n = la < lb ? la : lb;
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i])
+            return byte_diff(a, b, i);
+    }
+    return length_diff(la, lb);
+}
@@ -0,0 +1,20 @@
+#ifndef LAB0_STRCMP_SIMD_H
+#define LAB0_STRCMP_SIMD_H
+
+#include <stddef.h>
+
+/*
+ * Compare string a of length la with string b of length lb, ordering them
+ * like strcmp would. Neither string may contain a null byte before its end.
+ *
+ * Knowing the lengths up front lets the comparison run on whole vectors:
+ * 32 bytes per step with AVX2, 16 with SSE2, and 8 with plain word loads
+ * on other targets. The first differing byte is located with a movemask.
+ * AVX2 is used when the CPU running the program supports it.
+ */
+int strcmp_simd(const char *a, size_t la, const char *b, size_t lb);
+
+/* Same contract as strcmp_simd(), one byte at a time */
+int strcmp_scalar(const char *a, size_t la, const char *b, size_t lb);
+
+#endif /* LAB0_STRCMP_SIMD_H */
@@ -0,0 +1,42 @@
+# Test external sort against a memory limit far below the size of the queue
+option fail 0
+option malloc 0
+option ext_budget 16384
+new
+sort_external
+sort_external TMP
+load TMP
+size
+ih RAND 100000
+sort_external TMP
+load TMP
+reverse
+sort_external
+free
+option layout 1
+new
+it dolphin
+it bear
+it gerbil
+it aardvark
+it bear
+sort_external TMP
+load TMP
+rh aardvark
+rh bear
+rh bear
+rh dolphin
+rh gerbil
+it cherry
+it apple
+it banana
+save TMP
+free
+new
+load TMP
+sort_external TMP
+load TMP
+rh apple
+rh banana
+rh cherry
+free
@@ -0,0 +1,22 @@
+# Test priority queue order, and if time complexity of pq_insert is constant
+option fail 0
+option malloc 0
+pq_new
+pq_insert dolphin
+pq_insert bear
+pq_insert gerbil
+pq_insert bear
+pq_pop bear
+pq_insert aardvark
+pq_pop aardvark
+pq_pop bear
+pq_pop dolphin
+pq_pop gerbil
+pq_insert RAND 100000
+pq_pop
+pq_pop
+pq_pop
+pq_free
+option simulation 1
+pq_insert
+option simulation 0
@@ -0,0 +1,30 @@
+# Test dedup_unsorted on interned strings mixed with strings inserted by take
+option fail 0
+option malloc 0
+option layout 4
+new
+it apple
+it_take apple
+ih pear
+ih_take kiwi
+it pear
+it_take fig
+ih apple
+dedup_unsorted
+rh kiwi
+rh fig
+size 1
+free
+new
+it_take dolphin
+it_take bear
+it bear
+it dolphin
+it gerbil
+it_take gerbil
+it bear
+ih_take aardvark
+dedup_unsorted
+rh aardvark
+size 1
+free
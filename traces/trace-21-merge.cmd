@@ -0,0 +1,41 @@
+# Test merge of sorted queues, including queues with and without key prefixes
+option fail 0
+option malloc 0
+new
+it bear
+it gerbil
+it zebra
+stash a
+new
+it aardvark
+it gerbil
+it vulture
+stash b
+new
+it dolphin
+it gerbil
+merge a b
+rh aardvark
+rh bear
+rh dolphin
+rh gerbil
+rh gerbil
+rh gerbil
+rh vulture
+rh zebra
+free
+new
+ih RAND 20000
+sort
+stash plain
+option prefix 1
+new
+ih RAND 20000
+sort
+merge plain
+size
+reverse
+sort
+dedup
+free
+option prefix 0
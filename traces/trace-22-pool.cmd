@@ -0,0 +1,47 @@
+# Test of pool node reuse after removal, with and without keys, taken strings and malloc failure
+option fail 10
+option malloc 0
+option layout 1
+new
+ih RAND 100
+rh_bulk 100
+ih dolphin
+ih bear
+it gerbil
+ih RAND 500
+rt gerbil
+rt dolphin
+rt bear
+rh_bulk 500
+it_take meerkat
+ih_take vulture
+it zebra
+dm
+rh vulture
+rt_take zebra
+it aardvark
+ih squirrel
+rh squirrel
+rt aardvark
+free
+option prefix 1
+new
+ih RAND 100
+rt_bulk 100
+it yak
+ih bison
+ih_take a-string-long-enough-to-leave-any-inline-or-short-buffer
+sort
+rh a-string-long-enough-to-leave-any-inline-or-short-buffer
+rh bison
+rh_take yak
+free
+option prefix 0
+new
+option malloc 25
+ih gerbil 200
+rh_bulk 100
+it bear 200
+option malloc 0
+free
+option layout 0
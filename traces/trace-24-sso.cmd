@@ -0,0 +1,43 @@
+# Test of the sso layout with strings of 15, 16 and 17 bytes around the 16-byte buffer, with and without keys
+option fail 10
+option malloc 0
+option layout 3
+new
+it fifteen-bytes-x
+it sixteen-bytes-xx
+it seventeen-bytes-x
+ih fifteen-bytes-x
+ih sixteen-bytes-xx
+sort
+rh fifteen-bytes-x
+rh fifteen-bytes-x
+rt sixteen-bytes-xx
+rh_take seventeen-bytes-x
+rt_take sixteen-bytes-xx
+it fifteen-bytes-y
+it sixteen-bytes-yy
+it_take seventeen-bytes-y
+rh_bulk 3 50
+free
+option prefix 1
+new
+ih sixteen-bytes-xx
+ih fifteen-bytes-x
+ih seventeen-bytes-x
+ih fifteen-bytes-x
+it sixteen-bytes-xx
+it sixteen-bytes-yy
+swap
+sort
+dedup
+rh seventeen-bytes-x
+rt_take sixteen-bytes-yy
+free
+option prefix 0
+new
+option malloc 25
+ih fifteen-bytes-x 20
+it seventeen-bytes-x 20
+option malloc 0
+free
+option layout 0
@@ -0,0 +1,11 @@
+# Test if size is answered in constant time
+option fail 0
+option malloc 0
+new
+ih dolphin 1000000
+it gerbil 1000000
+size 1000000
+rh dolphin
+rt gerbil
+size
+free
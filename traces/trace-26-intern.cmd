@@ -0,0 +1,53 @@
+# Test of the intern layout with equal strings interned by different queues and outliving the queue that interned them
+option fail 0
+option malloc 0
+option layout 4
+new
+ih gerbil
+ih bear
+ih gerbil
+it dolphin
+sort
+stash first
+new
+it gerbil
+it bear
+it yak
+it gerbil
+sort
+merge first
+rh bear
+rh bear
+rh dolphin
+it gerbil
+dedup_unsorted
+rh yak
+ih gerbil 100
+stash first
+new
+ih bear 100
+it gerbil
+it zebra
+sort
+merge first
+dedup
+rh zebra
+free
+option prefix 1
+new
+ih gerbil
+ih bear
+ih gerbil
+sort
+stash first
+new
+it gerbil
+it bear
+it yak
+sort
+merge first
+dedup
+rh yak
+free
+option prefix 0
+option layout 0
@@ -0,0 +1,47 @@
+# Test of the radix sort engine on keys longer than its 64-byte depth limit and on long shared prefixes
+option fail 0
+option malloc 0
+option sort_engine 1
+new
+it the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-!zebra
+ih the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-! 40
+it the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-!aardvark
+ih the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-!mole
+it the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running
+ih the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-runnin
+it the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-
+ih zzz
+it aaa
+sort
+rh aaa
+rh the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-runnin
+rh the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running
+rh the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-
+rh_bulk 40
+rh the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-!aardvark
+rh the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-!mole
+rt zzz
+rt the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-!zebra
+free
+option prefix 1
+new
+ih the-quick-brown-fox-jumps-overbravo--the-lazy-dog-and-keeps-on-running-! 40
+it the-quick-brown-fox-jumps-overalpha--the-lazy-dog-and-keeps-on-running-! 40
+ih the-quick-brown-fox-jumps-overalpha--the-lazy-dog-and-keeps-on-running-!x
+it the-quic
+ih the-quic
+sort
+rh the-quic
+rh the-quic
+rt the-quick-brown-fox-jumps-overbravo--the-lazy-dog-and-keeps-on-running-!
+rt_bulk 39
+rt the-quick-brown-fox-jumps-overalpha--the-lazy-dog-and-keeps-on-running-!x
+dedup
+free
+option prefix 0
+new
+ih RAND 50000
+it the-quick-brown-fox-jumps-over-the-lazy-dog-and-keeps-on-running-! 20000
+sort
+free
+option sort_engine 0
@@ -0,0 +1,48 @@
+# Test of the array sort engine around its 16-node runs and falling back to merge sort when scratch allocation fails
+option fail 0
+option malloc 0
+option sort_engine 2
+new
+ih RAND 15
+sort
+it zzzzzzzzzzzz
+ih a
+sort
+rh a
+rt zzzzzzzzzzzz
+ih RAND 16
+sort
+ih RAND 1
+sort
+ih RAND 16
+sort
+free
+new
+ih RAND 33
+it zzzzzzzzzzzz 31
+sort
+reverse
+sort
+rt zzzzzzzzzzzz
+ih zzzzzzzzzzzzz
+it a
+option malloc 100
+sort
+reverse
+sort
+option malloc 0
+rh a
+rt zzzzzzzzzzzzz
+rt_bulk 30
+free
+option prefix 1
+new
+ih RAND 10000
+option malloc 100
+sort
+option malloc 0
+sort
+dedup
+free
+option prefix 0
+option sort_engine 0
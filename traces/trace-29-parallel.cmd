@@ -0,0 +1,55 @@
+# Test of the parallel sort engine on tiny queues and with more threads than half the nodes
+option fail 0
+option malloc 0
+option sort_engine 3
+option sort_cutoff 1
+option sort_threads 64
+new
+ih bear
+ih dolphin
+sort
+rh bear
+it gerbil
+ih dolphin
+ih aardvark
+sort
+rh aardvark
+rh dolphin
+rh dolphin
+rh gerbil
+it gerbil
+it dolphin
+it bear
+it aardvark
+it bear
+sort
+rh aardvark
+rh bear
+rh bear
+rt gerbil
+rt dolphin
+option sort_threads 3
+ih gerbil
+ih dolphin
+ih bear
+ih yak
+ih aardvark
+ih dolphin
+ih bear
+sort
+rh aardvark
+rh bear
+rh bear
+rt yak
+rt gerbil
+rt dolphin
+rt dolphin
+option sort_threads 100
+ih RAND 129
+sort
+reverse
+sort
+free
+option sort_threads 4
+option sort_cutoff 100000
+option sort_engine 0
@@ -0,0 +1,56 @@
+# Test of the natural sort engine on run lengths that need the second merge_collapse check, and on descending and presorted runs
+option fail 0
+option malloc 0
+option sort_engine 4
+new
+it gerbil 120
+it dolphin 80
+it cat 25
+it bear 20
+it aardvark 30
+sort
+rh aardvark
+rh_bulk 29
+rh bear
+rh_bulk 19
+rh cat
+rh_bulk 24
+rh dolphin
+rh_bulk 79
+rh gerbil
+rt gerbil
+free
+option prefix 1
+new
+it bear
+it aardvark
+it dolphin
+it cat
+it gerbil
+it gerbil
+it emu
+it yak
+it walrus
+it vulture
+sort
+rh aardvark
+rh bear
+rh cat
+rh dolphin
+rh emu
+rh gerbil
+rh gerbil
+rt yak
+rt walrus
+rt vulture
+free
+option prefix 0
+new
+it gerbil 100000
+ih dolphin 100000
+ih aardvark
+sort
+reverse
+sort
+free
+option sort_engine 0
@@ -0,0 +1,24 @@
+# Test of sort, dedup and merge with cached key prefixes, including strings sharing 8-byte prefixes
+option fail 0
+option malloc 0
+option prefix 1
+new
+ih abcdefghzz
+ih abcdefghaa
+ih abcdefgh
+ih abc
+ih abcdefghaa
+sort
+rh abc
+rh abcdefgh
+rh abcdefghaa
+rh abcdefghaa
+rh abcdefghzz
+ih RAND 200000
+it abcdefghij 10000
+it abcdefgh 10000
+sort
+dedup
+reverse
+free
+option prefix 0
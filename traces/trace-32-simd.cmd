@@ -0,0 +1,21 @@
+# Test of sort and dedup with the simd string compare, including long shared prefixes
+option fail 0
+option malloc 0
+option cmp_kernel 1
+new
+ih abcdefghijklmnopqrstuvwxyz-bear
+ih abcdefghijklmnopqrstuvwxyz-aardvark
+ih abcdefghijklmnopqrstuvwxyz
+ih abcdefghijklmnopqrstuvwxyz-bear
+ih a
+sort
+rh a
+rh abcdefghijklmnopqrstuvwxyz
+rh abcdefghijklmnopqrstuvwxyz-aardvark
+rh abcdefghijklmnopqrstuvwxyz-bear
+rh abcdefghijklmnopqrstuvwxyz-bear
+ih RAND 200000
+sort
+dedup
+free
+option cmp_kernel 0
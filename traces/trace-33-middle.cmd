@@ -0,0 +1,23 @@
+# Test of pm and dm, and if time complexity of pm is constant
+option fail 0
+option malloc 0
+new
+it dolphin
+it bear
+it gerbil
+it meerkat
+pm gerbil
+dm
+pm bear
+ih fish
+pm bear
+rt meerkat
+pm dolphin
+dm
+pm bear
+rh fish
+rh bear
+free
+option simulation 1
+pm
+option simulation 0
@@ -0,0 +1,26 @@
+# Test of shuffle keeping all strings, in both variants
+option fail 0
+option malloc 0
+option shuffle_seed 42
+new
+it aardvark
+it bear
+it dolphin
+it gerbil
+shuffle
+size
+sort
+rh aardvark
+rh bear
+rh dolphin
+rh gerbil
+it gerbil 100000
+ih RAND 100000
+shuffle
+option shuffle_inplace 1
+shuffle
+option shuffle_inplace 0
+sort
+dedup
+size
+free
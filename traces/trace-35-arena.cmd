@@ -0,0 +1,58 @@
+# Test of the arena layout growing at both ends across 64-slot chunks and freeing chunks emptied in the middle
+option fail 10
+option malloc 0
+option layout 5
+new
+it t0
+ih h0
+ih front 31
+ih h1
+it back 31
+it t1
+rh h1
+rt t1
+ih h2
+it t2
+ih mid 64
+ih top
+rh top
+rh mid
+rh_bulk 63
+rh h2
+ih h3
+rh h3
+it back 64
+it bottom
+rt bottom
+rt_bulk 64
+rt t2
+it t3
+rt t3
+rt_bulk 31
+rt t0
+rh_bulk 31
+rh h0
+ih h4
+it t4
+rh h4
+rt t4
+free
+option prefix 1
+new
+it bear 100
+ih gerbil 100
+ih a-string-long-enough-to-leave-any-inline-or-short-buffer
+dm
+rh a-string-long-enough-to-leave-any-inline-or-short-buffer
+rh_bulk 99
+rt_bulk 99
+rt bear
+free
+option prefix 0
+new
+option malloc 25
+ih gerbil 80
+it bear 80
+option malloc 0
+free
+option layout 0
@@ -0,0 +1,8 @@
+# Test of passing elements through the lock-free queue with several producers and consumers
+option fail 0
+option malloc 0
+mpmc
+mpmc 1 1 10000 2
+mpmc 4 1 100000 64
+mpmc 1 4 100000 64
+mpmc 4 4 200000 1024
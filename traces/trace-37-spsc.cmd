@@ -0,0 +1,20 @@
+# Test of the ring buffer order and wrap-around, filling it to capacity
+option fail 0
+option malloc 0
+spsc_new 4
+spsc_it dolphin
+spsc_it bear
+spsc_it gerbil
+spsc_rh dolphin
+spsc_it meerkat
+spsc_it fish
+spsc_rh bear
+spsc_rh gerbil
+spsc_rh meerkat
+spsc_rh fish
+spsc_it RAND 4
+spsc_free
+spsc_new
+spsc_it gerbil 1000
+spsc_rh gerbil
+spsc_free
@@ -0,0 +1,26 @@
+# Test of bulk removal at head and tail, stopping before a string that does not fit
+option fail 0
+option malloc 0
+new
+it dolphin
+it bear
+it gerbil
+it meerkat
+it fish
+rh_bulk 2
+rt_bulk 2 13
+rh gerbil
+it meerkat
+it fish
+rt_bulk 2 12
+rt meerkat
+option fail 10
+it gerbil
+rh_bulk 1 6
+rh gerbil
+option fail 0
+it gerbil 100000
+rh_bulk 50000
+rt_bulk 50000 1024
+size
+free
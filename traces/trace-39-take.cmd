@@ -0,0 +1,23 @@
+# Test of inserting and removing strings without copying them
+option fail 0
+option malloc 0
+new
+ih_take dolphin
+it_take bear
+ih_take gerbil
+it bear
+rh_take gerbil
+rt_take bear
+rh dolphin
+rt_take bear
+ih_take meerkat
+rh meerkat
+free
+option layout 1
+new
+ih_take dolphin
+it_take bear
+rh_take dolphin
+rt bear
+free
+option layout 0
@@ -0,0 +1,19 @@
+# Test of dedup checked against hashes of runs of equal strings
+option fail 0
+option malloc 0
+option dedup_check 1
+new
+it bear
+it bear
+it dolphin
+it gerbil
+it gerbil
+it gerbil
+dedup
+rh dolphin
+ih RAND 100000
+it gerbil 100000
+sort
+dedup
+free
+option dedup_check 0
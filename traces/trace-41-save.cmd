@@ -0,0 +1,21 @@
+# Test of saving a queue to a snapshot and loading it back
+option fail 0
+option malloc 0
+new
+it dolphin
+it bear
+it gerbil
+save TMP
+free
+new
+it aardvark
+load TMP
+rh aardvark
+rh dolphin
+rh bear
+rh gerbil
+ih RAND 100000
+save TMP
+load TMP
+sort
+free
@@ -0,0 +1,23 @@
+# Test of saving a loaded queue back to the snapshot it was loaded from
+option fail 0
+option malloc 0
+new
+it apple
+it banana
+it cherry
+save TMP
+free
+new
+load TMP
+save TMP
+rh apple
+it dates
+save TMP
+load TMP
+rh banana
+rh cherry
+rh dates
+rh banana
+rh cherry
+rh dates
+free
@@ -0,0 +1,26 @@
+# Test of freeing queues while a ring buffer and a priority queue are live
+option fail 0
+option malloc 0
+spsc_new 8
+spsc_it dolphin
+new
+it bear
+it gerbil
+free
+pq_new
+pq_insert meerkat
+new
+ih fish
+rh fish
+free
+spsc_free
+new
+it aardvark
+free
+pq_pop meerkat
+pq_free
+spsc_new
+new
+it gerbil
+free
+spsc_free